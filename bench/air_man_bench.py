@@ -0,0 +1,151 @@
+#!/usr/bin/python3
+"""Replay a ground-station command mix against air_man and report latency.
+
+Each client thread walks the mix from its own offset, one command at a time,
+either as air_man_gs does (a connection per command) or over one "session"
+connection. Prints throughput and p50/p95/p99/max overall and per command
+(first word), and optionally air_man's own "stats" afterwards.
+"""
+
+import argparse
+import socket
+import threading
+import time
+
+# ─── Client ─────────────────────────────────────────────────────────────
+
+def one_shot(host, port, cmd, timeout):
+    with socket.create_connection((host, port), timeout=timeout) as s:
+        s.sendall(cmd.encode() + b"\n")
+        s.shutdown(socket.SHUT_WR)
+        chunks = []
+        while True:
+            data = s.recv(4096)
+            if not data:
+                break
+            chunks.append(data)
+    return b"".join(chunks).decode(errors="replace")
+
+
+class Session:
+    def __init__(self, host, port, timeout):
+        self.sock = socket.create_connection((host, port), timeout=timeout)
+        self.rfile = self.sock.makefile("rb")
+        self.sock.sendall(b"session\n")
+        self.reply()                                  # "session started"
+
+    def reply(self):
+        lines = []
+        while True:
+            line = self.rfile.readline()
+            if not line:
+                raise ConnectionError("session closed")
+            line = line.decode(errors="replace").rstrip("\n")
+            if line == ".":
+                return "\n".join(lines)
+            lines.append(line[1:] if line.startswith("..") else line)
+
+    def run(self, cmd):
+        self.sock.sendall(cmd.encode() + b"\n")
+        return self.reply()
+
+    def close(self):
+        self.sock.close()
+
+# ─── Load ───────────────────────────────────────────────────────────────
+
+def load_mix(path):
+    with open(path) as f:
+        return [l.strip() for l in f if l.strip() and not l.lstrip().startswith("#")]
+
+
+def worker(idx, args, mix, deadline, results, lock):
+    samples, errors = [], 0
+    session = Session(args.host, args.port, args.timeout) if args.session else None
+    i = idx * len(mix) // args.concurrency
+    done = 0
+    while (args.count and done < args.count) or (not args.count and time.monotonic() < deadline):
+        cmd = mix[i % len(mix)]
+        i += 1
+        done += 1
+        t0 = time.monotonic()
+        try:
+            reply = session.run(cmd) if session else one_shot(args.host, args.port, cmd, args.timeout)
+        except OSError as e:
+            reply = f"Error: {e}"
+            if session:
+                session.close()
+                session = Session(args.host, args.port, args.timeout)
+        samples.append((cmd.split()[0], time.monotonic() - t0))
+        if reply.startswith("Error"):
+            errors += 1
+            if args.verbose:
+                print(f"{cmd}: {reply.splitlines()[0]}")
+    if session:
+        session.close()
+    with lock:
+        results["samples"] += samples
+        results["errors"] += errors
+
+# ─── Report ─────────────────────────────────────────────────────────────
+
+def pct(sorted_ms, p):
+    return sorted_ms[min(len(sorted_ms) - 1, max(0, -(-len(sorted_ms) * p // 100) - 1))]
+
+
+def line(name, ms):
+    ms.sort()
+    return (f"{name:<20} n={len(ms):<6} p50={pct(ms, 50):.2f}ms p95={pct(ms, 95):.2f}ms "
+            f"p99={pct(ms, 99):.2f}ms max={ms[-1]:.2f}ms")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("mix", help="command mix, one command per line (see bench/mix.txt)")
+    ap.add_argument("-H", "--host", default="127.0.0.1")
+    ap.add_argument("-p", "--port", type=int, default=12355)
+    ap.add_argument("-c", "--concurrency", type=int, default=4, help="client threads")
+    ap.add_argument("-d", "--duration", type=float, default=10, help="seconds to run")
+    ap.add_argument("-n", "--count", type=int, default=0, help="commands per client instead of -d")
+    ap.add_argument("-s", "--session", action="store_true", help="one session connection per client")
+    ap.add_argument("-t", "--timeout", type=float, default=20, help="per-command timeout, s")
+    ap.add_argument("--stats", action="store_true", help="print air_man's own stats afterwards")
+    ap.add_argument("-v", "--verbose", action="store_true", help="print error replies")
+    args = ap.parse_args()
+
+    mix = load_mix(args.mix)
+    if not mix:
+        ap.error(f"{args.mix}: no commands")
+    results, lock = {"samples": [], "errors": 0}, threading.Lock()
+    start = time.monotonic()
+    threads = [threading.Thread(target=worker,
+                                args=(i, args, mix, start + args.duration, results, lock))
+               for i in range(args.concurrency)]
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    elapsed = time.monotonic() - start
+
+    samples = results["samples"]
+    if not samples:
+        print("no commands completed")
+        return 1
+    print(f"{len(samples)} commands in {elapsed:.1f} s, {args.concurrency} clients "
+          f"({'session' if args.session else 'one-shot'}): {len(samples) / elapsed:.1f} cmd/s, "
+          f"{results['errors']} errors")
+    print(line("all", [s * 1000 for _, s in samples]))
+    by_cmd = {}
+    for name, s in samples:
+        by_cmd.setdefault(name, []).append(s * 1000)
+    for name in sorted(by_cmd, key=lambda n: -len(by_cmd[n])):
+        print(line(name, by_cmd[name]))
+
+    if args.stats:
+        print()
+        print(one_shot(args.host, args.port, "stats", args.timeout))
+    return 0
+
+
+if __name__ == "__main__":
+    raise SystemExit(main())
@@ -0,0 +1,19 @@
+#!/bin/sh
+# Fake drone tool for the forking benchmark build: bench/run.sh links every
+# tool of tools.conf to this script. It looks itself up by name, sleeps for
+# the tool's latency and prints its output.
+# Only shell builtins and sleep are used, since sed, sh etc. may be faked too.
+
+table=$AIR_MAN_STUB_TOOLS
+name=${0##*/}
+
+while read -r tool ms code out; do
+    case "$tool" in ''|\#*) continue ;; esac
+    [ "$tool" = "$name" ] || continue
+    [ "$ms" -gt 0 ] && sleep "$(printf '%d.%03d' $((ms / 1000)) $((ms % 1000)))"
+    [ -n "$out" ] && echo "$out"
+    exit "$code"
+done < "$table"
+
+echo "$name: not in $table" >&2
+exit 127
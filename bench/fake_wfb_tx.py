@@ -0,0 +1,46 @@
+#!/usr/bin/python3
+"""Answer wfb_tx's UDP control protocol (src/wfb_tx_client.h) on localhost.
+
+Keeps the radio and FEC settings it is given and accepts every change, so
+air_man's native MCS/FEC paths can be benchmarked without a wifi card.
+"""
+
+import argparse
+import socket
+import struct
+
+SET_FEC, SET_RADIO, GET_FEC, GET_RADIO = 1, 2, 3, 4
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("-p", "--port", type=int, default=8000)
+    args = ap.parse_args()
+
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    s.bind(("127.0.0.1", args.port))
+    # stbc, ldpc, short_gi, bandwidth, mcs_index, vht_mode, vht_nss
+    radio = bytes([1, 1, 0, 20, 2, 0, 1])
+    fec = bytes([8, 12])
+    while True:
+        data, peer = s.recvfrom(64)
+        if len(data) < 5:
+            continue
+        req_id, cmd = struct.unpack("!IB", data[:5])
+        body, reply = data[5:], b""
+        if cmd == SET_FEC and len(body) == len(fec):
+            fec = body
+        elif cmd == SET_RADIO and len(body) == len(radio):
+            radio = body
+        elif cmd == GET_FEC:
+            reply = fec
+        elif cmd == GET_RADIO:
+            reply = radio
+        else:
+            s.sendto(struct.pack("!II", req_id, 22), peer)        # EINVAL
+            continue
+        s.sendto(struct.pack("!II", req_id, 0) + reply, peer)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,64 @@
+#!/bin/sh
+# Build air_man for this PC against a scratch copy of vtx/, start it, and
+# replay a command mix with air_man_bench.py. See bench/README.md.
+#
+#   bench/run.sh [--fork] [air_man_bench.py options] [mix]
+#
+# --fork links src/child_exec.c and fake_tool.sh stand-ins, so every tool
+# call is a real fork/exec. Without it, bench/stub_exec.c answers them in
+# process and only air_man's own code is measured. fake_wfb_tx.py stands in
+# for wfb_tx's control port either way.
+
+set -e
+
+BENCH=$(cd "$(dirname "$0")" && pwd)
+SRC=$BENCH/../src
+WORK=${AIR_MAN_BENCH_DIR:-/tmp/air_man_bench}
+ROOT=$WORK/root
+
+EXEC=$BENCH/stub_exec.c
+if [ "$1" = "--fork" ]; then
+    EXEC=$SRC/child_exec.c
+    shift
+fi
+
+# ─── Scratch drone filesystem ───
+rm -rf "$WORK"
+mkdir -p "$ROOT/usr/bin" "$WORK/bin" \
+         "$ROOT/proc/mi_modules/mi_vpe" "$ROOT/proc/mi_modules/mi_sensor"
+cp -r "$BENCH/../vtx/etc" "$ROOT/etc"
+cp "$BENCH/majestic.yaml" "$ROOT/etc/majestic.yaml"
+echo "16:9 1080p 60" > "$ROOT/etc/sensors/mode_current"
+printf 'ChnId  Status\n    0       1\n' > "$ROOT/proc/mi_modules/mi_vpe/mi_vpe0"
+: > "$ROOT/proc/mi_modules/mi_sensor/mi_sensor0"
+
+# Every tool in the table becomes a fake_tool.sh link, first on PATH (and
+# at the absolute paths air_man uses).
+grep -v '^#' "$BENCH/tools.conf" | while read -r tool rest; do
+    [ -n "$tool" ] && ln -s "$BENCH/fake_tool.sh" "$WORK/bin/$tool"
+done
+ln -s "$BENCH/fake_tool.sh" "$ROOT/usr/bin/air_man_cmd.sh"
+ln -s "$BENCH/fake_tool.sh" "$ROOT/usr/bin/alink_drone"
+
+# ─── Build ───
+${CC:-gcc} -O2 -pthread -I"$SRC" -DAIR_MAN_SYSROOT="\"$ROOT\"" -o "$WORK/air_man" \
+    "$SRC/air_man.c" "$SRC/stupid-yaml.c" "$SRC/majestic.c" "$SRC/wlan_ctl.c" \
+    "$SRC/alink_client.c" "$SRC/link_modes.c" "$SRC/wfb_tx_client.c" \
+    "$SRC/txprofiles.c" "$SRC/mi_proc.c" "$SRC/stats.c" "$EXEC"
+
+# ─── Run ───
+WFB_PORT=${AIR_MAN_BENCH_WFB_PORT:-18000}
+python3 "$BENCH/fake_wfb_tx.py" -p "$WFB_PORT" &
+WFB_PID=$!
+export AIR_MAN_STUB_TOOLS="$BENCH/tools.conf"
+PATH="$WORK/bin:$PATH" "$WORK/air_man" -w "$WFB_PORT" > "$WORK/air_man.log" 2>&1 &
+PID=$!
+trap 'kill $PID $WFB_PID 2>/dev/null' EXIT INT TERM
+sleep 1
+kill -0 $PID 2>/dev/null || { cat "$WORK/air_man.log"; exit 1; }
+
+# A mix file given last on the command line replaces bench/mix.txt.
+last=
+for arg; do last=$arg; done
+[ -f "$last" ] || set -- "$@" "$BENCH/mix.txt"
+python3 "$BENCH/air_man_bench.py" "$@"
@@ -0,0 +1,132 @@
+/*
+ * stub_exec.c - child_exec.h without forking, for PC benchmarks
+ *
+ * Commands are answered from the tool table named by $AIR_MAN_STUB_TOOLS
+ * (bench/tools.conf format: "<tool> <latency_ms> <exit> [output]"). The
+ * tool is the basename of the command's first word; the call sleeps for
+ * its latency and returns its exit code and output. Tools missing from the
+ * table fail as the shell would (exit 127). Link this instead of
+ * src/child_exec.c; bench/run.sh does.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "child_exec.h"
+
+#define STUB_MAX_TOOLS 64
+#define STUB_MAX_PIPES 16
+
+typedef struct {
+    char name[32];
+    int latency_ms;
+    int exit_code;
+    char output[128];
+} stub_tool_t;
+
+static stub_tool_t tools[STUB_MAX_TOOLS];
+static int n_tools;
+static pthread_once_t tools_once = PTHREAD_ONCE_INIT;
+
+// Open child_popen() streams and what child_pclose() returns for them.
+static struct {
+    FILE *f;
+    char *buf;
+    int status;
+} pipes[STUB_MAX_PIPES];
+static pthread_mutex_t pipes_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void load_tools(void) {
+    const char *file = getenv("AIR_MAN_STUB_TOOLS");
+    FILE *f = file ? fopen(file, "r") : NULL;
+    if (!f) {
+        fprintf(stderr, "[WARN] stub_exec: no tool table (AIR_MAN_STUB_TOOLS=%s)\n",
+                file ? file : "");
+        return;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), f) && n_tools < STUB_MAX_TOOLS) {
+        line[strcspn(line, "\r\n")] = '\0';
+        stub_tool_t *t = &tools[n_tools];
+        int end = 0;
+        if (line[0] == '#' ||
+            sscanf(line, "%31s %d %d %n", t->name, &t->latency_ms, &t->exit_code, &end) != 3)
+            continue;
+        snprintf(t->output, sizeof(t->output), "%s", line + end);
+        n_tools++;
+    }
+    fclose(f);
+}
+
+static const stub_tool_t *find_tool(const char *cmd) {
+    pthread_once(&tools_once, load_tools);
+    cmd += strspn(cmd, " \t");
+    size_t len = strcspn(cmd, " \t;&|>");
+    const char *slash = memrchr(cmd, '/', len);
+    if (slash) {
+        len -= slash + 1 - cmd;
+        cmd = slash + 1;
+    }
+    for (int i = 0; i < n_tools; i++)
+        if (strlen(tools[i].name) == len && strncmp(tools[i].name, cmd, len) == 0)
+            return &tools[i];
+    return NULL;
+}
+
+// Sleep like the tool would and return its wait status.
+static int run_stub(const stub_tool_t *t) {
+    if (!t) return 127 << 8;
+    if (t->latency_ms > 0) usleep(t->latency_ms * 1000);
+    return (t->exit_code & 0xff) << 8;
+}
+
+int child_system(const char *cmd) {
+    return run_stub(find_tool(cmd));
+}
+
+FILE *child_popen(const char *cmd) {
+    const stub_tool_t *t = find_tool(cmd);
+    int status = run_stub(t);
+    char *buf = NULL;
+    if (asprintf(&buf, "%s%s", t ? t->output : "", t && t->output[0] ? "\n" : "") < 0) return NULL;
+    FILE *f = fmemopen(buf, strlen(buf), "r");
+    if (!f) {
+        free(buf);
+        return NULL;
+    }
+    pthread_mutex_lock(&pipes_lock);
+    for (int i = 0; i < STUB_MAX_PIPES; i++) {
+        if (pipes[i].f) continue;
+        pipes[i].f = f;
+        pipes[i].buf = buf;
+        pipes[i].status = status;
+        pthread_mutex_unlock(&pipes_lock);
+        return f;
+    }
+    pthread_mutex_unlock(&pipes_lock);
+    fclose(f);
+    free(buf);
+    return NULL;
+}
+
+int child_pclose(FILE *f) {
+    int status = -1;
+    char *buf = NULL;
+    pthread_mutex_lock(&pipes_lock);
+    for (int i = 0; i < STUB_MAX_PIPES; i++) {
+        if (pipes[i].f != f) continue;
+        status = pipes[i].status;
+        buf = pipes[i].buf;
+        pipes[i].f = NULL;
+        pipes[i].buf = NULL;
+        break;
+    }
+    pthread_mutex_unlock(&pipes_lock);
+    fclose(f);
+    free(buf);
+    return status;
+}
@@ -2,9 +2,20 @@
  * server.c - air_manager: TCP server for drone
  *
  * Compile with:
- *     gcc -pthread -o air_manager server.c
+ *     gcc -pthread -o air_man air_man.c stupid-yaml.c majestic.c wlan_ctl.c alink_client.c \
+ *         link_modes.c wfb_tx_client.c txprofiles.c mi_proc.c stats.c child_exec.c
+ * (bench/run.sh builds a PC variant with stubbed tools; see bench/README.md)
  *
- * This server listens on port 12355. On startup, it:
+ * This server listens on port 12355 from a single epoll loop. Commands that
+ * only read in-memory state are answered inline; commands that shell out or
+ * sleep run on a fixed worker pool split into lanes (fast reads, config
+ * writes, disruptive restarts), each with its own threads and bounded queue.
+ * When a lane's queue is full the client gets
+ * "Error: air_man busy (<lane> queue full), try again."
+ * Hot "get air ..." / "values air ..." queries are answered inline from the
+ * cached majestic.yaml and wfb.yaml; other commands fall back to the script.
+ *
+ * On startup, it:
  *   - Reads configuration from /etc/wfb.yaml
  *   - Detects wifi card(s) and SoC type
  *   - Automatically starts alink_drone (via start_alink command)
@@ -12,17 +23,61 @@
  * It supports the following commands:
  *   start_alink                    - start alink_drone on the drone.
  *   stop_alink                     - stop alink_drone (killall alink_drone)
- *   restart_majestic               - restart majestic (killall -HUP majestic)
- *   change_channel <channel>       - change channel; waits for confirmation via "confirm_channel_change"
- *   confirm_channel_change         - confirms pending channel change
+ *   alink_status                   - ask alink_drone for its status over the command socket
+ *   get_radio / get_fec            - wfb_tx's radio and FEC settings, as "wfb_tx_cmd 8000
+ *                                    get_radio|get_fec" prints them (native client,
+ *                                    wfb_tx_client.c; port 8000 or -w/--wfb-port=<port>)
+ *   set_alink_power <0-10>         - set alink power level (socket + /etc/alink.conf)
+ *   restart_majestic               - restart majestic (SIGHUP)
+ *   change_channel <channel>       - change channel; reverts unless confirmed in CONFIRM_TIMEOUT s
+ *   change_bandwidth <10|20|40|80> - change channel width; same confirm rule
+ *   change_mcs <0-7>               - change MCS (via tx_manager.sh); same confirm rule
+ *   change_txpower <0-10>          - change TX power index; same confirm rule
+ *   change_video_mode '<name>'     - set_simple_video_mode with the same confirm rule
+ *   confirm [<kind>]               - persist pending change(s): channel, bandwidth,
+ *                                    mcs, txpower, video_mode; all if omitted
+ *   confirm_channel_change         - alias for "confirm channel"
+ *   pending                        - list unconfirmed changes and time left
  *   set_video_mode <size> <fps> <exposure> '<crop>'
- *                                 - atomically set video parameters
+ *                                 - atomically set video parameters; fps and
+ *                                   exposure go live over majestic's HTTP API,
+ *                                   size/crop changes reload majestic. The reply
+ *                                   echoes the mode, then "| <step> <ms>ms, ..."
  *   restart_wfb                    - restart wifibroadcast and request idr.
  *   restart_msposd                 - restart the msposd process using wifibroadcast
+ *   link_modes list|info|get_auto <kbps>|solve <kbps>
+ *                                  - link mode catalog queries, as datalink_manager.sh
+ *                                    --list-modes / --info / --get-auto; solve picks
+ *                                    mode, FEC and mlink together
+ *   set_link_profile <kbps> [mode <name>] [fec <k>/<n>] [txpower <idx>]
+ *                                  - apply bitrate, width, MCS/GI, FEC and TX power as
+ *                                    one transaction (see "Link profile transaction")
+ *   txprofile [<score>]            - apply the /etc/txprofiles.conf row for an alink link
+ *                                    score, sending only the parameters that change
+ *   set_sensor_fps <fps>           - "setfps 0 <fps>" straight to the sensor driver, as
+ *                                    alink's fpsCommandTemplate (majestic.yaml untouched)
+ *   pipeline_status                - how long the last majestic reload took until the
+ *                                    VPE was up again, and whether the crop went in
+ *   cache_stats                    - hit/miss counters of the script result cache
+ *   stats [<cmd>|reset]            - per-command latency (parse, queue, exec, child,
+ *                                    write: count, p50/p95/p99, max) and counters for
+ *                                    forks, connections, timeouts and reverts; see stats.h
+ *   subscribe [interval_ms]        - stream link telemetry (channel, MCS, FEC, TX power,
+ *                                    bitrate/fps, alink status) every interval_ms
+ *                                    (default 1000); see "Telemetry subscriptions"
+ *   session                        - (first line only) keep the connection open and
+ *                                    treat every following line as a command; see
+ *                                    "Event loop" below for the framing
  *
  * Use the --verbose flag on the command line to output detailed debug messages.
+ * MCS and FEC changes go to wfb_tx over its UDP control port instead of
+ * forking wfb_tx_cmd; -w <port> / --wfb-port=<port> points that client at
+ * another port (e.g. a stand-in server).
+ * -j <sec> / --stats-json=<sec> also writes the "stats" data as JSON to
+ * /tmp/air_man_stats.json every <sec> seconds.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -36,77 +91,82 @@
 #include <getopt.h>
 #include <sys/un.h>
 #include <stdbool.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <ctype.h>
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+
+#include "stupid-yaml.h"
+#include "majestic.h"
+#include "wlan_ctl.h"
+#include "alink_client.h"
+#include "link_modes.h"
+#include "wfb_tx_client.h"
+#include "txprofiles.h"
+#include "mi_proc.h"
+#include "stats.h"
+#include "sysroot.h"
+#include "child_exec.h"
 
 
 #define PORT 12355
 #define BUF_SIZE 1024
 #define CONFIRM_TIMEOUT 15 // seconds
-#define DEFAULT_SCRIPT_PATH "/usr/bin/air_man_cmd.sh"
+#define MAX_CONNS 32           // concurrent client connections
+#define MAX_EVENTS 16          // epoll batch size
+#define CONN_IDLE_TIMEOUT 5    // seconds to wait for a complete command
+#define DEFAULT_SCRIPT_PATH AIR_MAN_SYSROOT "/usr/bin/air_man_cmd.sh"
+#define RC_LOCAL AIR_MAN_SYSROOT "/etc/rc.local"
+#define MODE_CURRENT_FILE AIR_MAN_SYSROOT "/etc/sensors/mode_current"
 static char *script = DEFAULT_SCRIPT_PATH;
 
-// ─── Shared protocol definitions ───
-// For comms with alink
-enum {
-    CMD_SET_POWER      = 1,
-    CMD_GET_STATUS     = 2,
-    // … add more as you need
-    CMD_STATUS_REPLY   = 0x8000    // OR’d into cmd for replies
-};
-
-struct __attribute__((packed)) alink_msg_hdr {
-    uint16_t cmd;   // one of CMD_*
-    uint16_t len;   // length of payload in bytes
-};
+static long long monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
 
-// ────────────────────────────────────
-// Path to the AF_UNIX socket used by alink
-#define ALINK_CMD_SOCKET_PATH  "/tmp/alink_cmd.sock"
+static long elapsed_ms(const struct timespec *t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) * 1000 + (t1.tv_nsec - t0->tv_nsec) / 1000000;
+}
 
-// Path to your alink config file to update there
-#define ALINK_CONFIG_FILE      "/etc/alink.conf"
-
-// Sends a CMD_SET_POWER TLV to alink, returns 0 on OK, 1 on out-of-range, -1 on error
-static int airman_send_set_power(int new_level) {
-    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (fd < 0) return -1;
-
-    struct sockaddr_un addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sun_family = AF_UNIX;
-    strncpy(addr.sun_path,
-            ALINK_CMD_SOCKET_PATH,
-            sizeof(addr.sun_path)-1);
-			
-    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        close(fd);
-        return -1;
-    }
+static long elapsed_us(const struct timespec *t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) * 1000000 + (t1.tv_nsec - t0->tv_nsec) / 1000;
+}
 
-    // build request
-    int32_t net_v = htonl(new_level);
-    struct alink_msg_hdr hdr = {
-        .cmd = htons(CMD_SET_POWER),
-        .len = htons(sizeof(net_v))
-    };
-    if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
-        write(fd, &net_v, sizeof(net_v)) != sizeof(net_v)) {
-        close(fd);
-        return -1;
-    }
+// Time the command running on this thread spent in system() children, and
+// how many it ran; the worker resets and records them around each command.
+static __thread long long child_us;
+static __thread int child_runs;
+
+static int run_child(const char *cmd) {
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int rc = child_system(cmd);
+    child_us += elapsed_us(&t0);
+    child_runs++;
+    stats_count(STAT_FORKS, 1);
+    return rc;
+}
 
-    // read reply
-    if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) { close(fd); return -1; }
-    hdr.cmd = ntohs(hdr.cmd);
-    hdr.len = ntohs(hdr.len);
-    if (hdr.cmd != (CMD_SET_POWER|CMD_STATUS_REPLY) || hdr.len != 4) {
-        close(fd);
-        return -1;
+// Path to your alink config file to update there
+#define ALINK_CONFIG_FILE      AIR_MAN_SYSROOT "/etc/alink.conf"
+
+// Reply text for an alink_* status code.
+static const char *alink_status_str(int st) {
+    switch (st) {
+    case 0:  return "OK";
+    case 1:  return "value out-of-range";
+    case -1: return "socket error";
+    default: return "rejected by alink";
     }
-    int32_t net_status;
-    if (read(fd, &net_status, 4) != 4) { close(fd); return -1; }
-    close(fd);
-
-    return ntohl(net_status);  // 0=OK, 1=out-of-range
 }
 
 // Updates the alink config file’s power_level_0_to_4 via sed.
@@ -117,7 +177,7 @@ static int update_alink_config_power(int new_level) {
     snprintf(cmd, sizeof(cmd),
       "sed -i 's/^power_level_0_to_4=[0-9]\\+/power_level_0_to_4=%d/' %s",
       new_level, ALINK_CONFIG_FILE);
-    return system(cmd);
+    return run_child(cmd);
 }
 
 
@@ -130,42 +190,89 @@ int current_channel = 0;
 char current_resolution[32] = "1280x720";
 int current_fps = 30;
 int current_bandwidth = 20;
+int current_mcs = 0;
+int current_txpower = 1;            // tx_manager.sh power index
+char current_video_mode[128] = "";  // name from /etc/sensors/mode_current
 char bw_string[10] = "";
 
 
+// One entry of the [modes] section of /etc/sensors/modes_<sensor>.ini,
+// parsed once at startup.
 typedef struct {
-    char name[64];
-    char command[256];
+    char *name;             // "16:9 1080p 90"
+    char *spec;             // original right-hand side, echoed back to clients
+    char size[16];          // "1920x1080"
+    int width, height;
+    int fps;
+    int exposure;
+    char crop[64];          // "nocrop" or "x y w h" for setprecrop
 } VideoMode;
 
-#define MAX_MODES 84
-VideoMode video_modes[MAX_MODES];
-int video_mode_count = 0;
-
+static VideoMode *video_modes;
+static int video_mode_count, video_mode_cap;
+static int *video_mode_index;       // open addressing, -1 = empty slot
+static unsigned video_mode_index_mask;
+static char *video_mode_list;       // precomputed get_all_video_modes reply
 
-// Structure to hold pending changes that require confirmation.
-// Only channel changes require confirmation now.
-typedef struct {
-    int pending_channel;
-    int original_channel;
-    int pending_channel_flag;
-    time_t pending_channel_time;
+static unsigned video_mode_hash(const char *name) {
+    unsigned h = 2166136261u;
+    while (*name) { h ^= (unsigned char)*name++; h *= 16777619u; }
+    return h;
+}
 
-    pthread_mutex_t lock;
-} pending_changes_t;
+static const VideoMode *find_video_mode(const char *name) {
+    if (!video_mode_index) return NULL;
+    for (unsigned i = video_mode_hash(name) & video_mode_index_mask;
+         video_mode_index[i] >= 0; i = (i + 1) & video_mode_index_mask) {
+        const VideoMode *m = &video_modes[video_mode_index[i]];
+        if (strcmp(m->name, name) == 0) return m;
+    }
+    return NULL;
+}
 
-pending_changes_t pending;
+// Parse "<size> <fps> <exposure> '<crop>'" (crop may also be double-quoted).
+static int parse_video_mode_spec(const char *spec, VideoMode *m) {
+    if (sscanf(spec, "%15s %d %d '%63[^']'", m->size, &m->fps, &m->exposure, m->crop) != 4 &&
+        sscanf(spec, "%15s %d %d \"%63[^\"]\"", m->size, &m->fps, &m->exposure, m->crop) != 4)
+        return -1;
+    if (sscanf(m->size, "%dx%d", &m->width, &m->height) != 2) m->width = m->height = 0;
+    return 0;
+}
 
+// Build the name index and the get_all_video_modes reply once all modes are in.
+static void index_video_modes(void) {
+    unsigned cap = 16;
+    while (cap < (unsigned)video_mode_count * 2) cap <<= 1;
+    free(video_mode_index);
+    video_mode_index = malloc(cap * sizeof(int));
+    if (!video_mode_index) { perror("malloc"); exit(1); }
+    memset(video_mode_index, 0xff, cap * sizeof(int));
+    video_mode_index_mask = cap - 1;
+
+    size_t list_len = 0;
+    for (int n = 0; n < video_mode_count; n++) {
+        list_len += strlen(video_modes[n].name) + 1;
+        if (find_video_mode(video_modes[n].name)) {
+            fprintf(stderr, "[WARN] Duplicate video mode \"%s\" ignored\n", video_modes[n].name);
+            continue;
+        }
+        unsigned i = video_mode_hash(video_modes[n].name) & video_mode_index_mask;
+        while (video_mode_index[i] >= 0) i = (i + 1) & video_mode_index_mask;
+        video_mode_index[i] = n;
+    }
 
-// Initialize pending changes structure
-void init_pending_changes() {
-    pending.pending_channel_flag = 0;
-    pthread_mutex_init(&pending.lock, NULL);
+    free(video_mode_list);
+    video_mode_list = malloc(list_len + 1);
+    if (!video_mode_list) { perror("malloc"); exit(1); }
+    char *p = video_mode_list;
+    for (int n = 0; n < video_mode_count; n++)
+        p += sprintf(p, "%s\n", video_modes[n].name);
+    *p = '\0';
 }
 
 void load_video_modes(const char *fn) {
-    if (access(fn, R_OK) != 0) {
-        fprintf(stderr, "[WARN] Cannot read %s\n", fn);
+    if (!fn || access(fn, R_OK) != 0) {
+        fprintf(stderr, "[WARN] Cannot read %s\n", fn ? fn : "video mode file");
         return;
     }
     FILE *f = fopen(fn, "r");
@@ -198,76 +305,309 @@ void load_video_modes(const char *fn) {
         char *q1 = strchr(p, '"');
         char *q2 = q1 ? strchr(q1+1, '"') : NULL;
         if (!q1||!q2) continue;
-        size_t nl = q2 - (q1+1);
-        if (nl >= sizeof(video_modes[0].name)) nl = sizeof(video_modes[0].name)-1;
 
         // extract "command"
         char *r1 = strchr(q2+1, '"');
         char *r2 = r1 ? strchr(r1+1, '"') : NULL;
         if (!r1||!r2) continue;
-        size_t cl = r2 - (r1+1);
-        if (cl >= sizeof(video_modes[0].command)) cl = sizeof(video_modes[0].command)-1;
+        *q2 = *r2 = 0;
 
-        if (video_mode_count < MAX_MODES) {
-            strncpy(video_modes[video_mode_count].name,  q1+1, nl);
-            video_modes[video_mode_count].name[nl] = 0;
-            strncpy(video_modes[video_mode_count].command, r1+1, cl);
-            video_modes[video_mode_count].command[cl] = 0;
-            if (verbose) 
-                printf("[DBG] %d: \"%s\" → \"%s\"\n",
-                       video_mode_count,
-                       video_modes[video_mode_count].name,
-                       video_modes[video_mode_count].command);
-            video_mode_count++;
+        VideoMode m = {0};
+        if (parse_video_mode_spec(r1+1, &m) != 0) {
+            fprintf(stderr, "[WARN] Bad video mode \"%s\" = \"%s\"\n", q1+1, r1+1);
+            continue;
         }
+        if (video_mode_count == video_mode_cap) {
+            int cap = video_mode_cap ? video_mode_cap * 2 : 32;
+            VideoMode *nm = realloc(video_modes, cap * sizeof(VideoMode));
+            if (!nm) { perror("realloc"); break; }
+            video_modes = nm;
+            video_mode_cap = cap;
+        }
+        m.name = strdup(q1+1);
+        m.spec = strdup(r1+1);
+        if (!m.name || !m.spec) { perror("strdup"); exit(1); }
+        video_modes[video_mode_count] = m;
+        if (verbose)
+            printf("[DBG] %d: \"%s\" → %s %d fps exp %d crop '%s'\n",
+                   video_mode_count, m.name, m.size, m.fps, m.exposure, m.crop);
+        video_mode_count++;
     }
 
     fclose(f);
+    index_video_modes();
     if (video_mode_count)
         printf("[INFO] Loaded %d modes from %s\n", video_mode_count, fn);
     else
         fprintf(stderr, "[WARN] No modes loaded from %s\n", fn);
 }
 
+// Reply to get_all_video_modes: one name per line, built at load time.
+static const char *video_modes_response(void) {
+    return video_mode_count ? video_mode_list : "No video modes loaded.";
+}
 
-// Generic function to run yaml-cli and get output as a string
-char* read_yaml_value(const char* yaml_file, const char* yaml_path) {
-    char command[512];
-    snprintf(command, sizeof(command), "yaml-cli -i %s -g %s", yaml_file, yaml_path);
 
-    FILE* fp = popen(command, "r");
-    if (!fp) { perror("popen failed"); return NULL; }
+// Parsed config files, reloaded only when they change on disk.
+#define WFB_YAML AIR_MAN_SYSROOT "/etc/wfb.yaml"
+static YAMLCache wfb_yaml = YAML_CACHE_INIT(WFB_YAML);
+static YAMLCache majestic_yaml = YAML_CACHE_INIT(MAJESTIC_CONFIG);
+#define WLAN_ADAPTERS_YAML AIR_MAN_SYSROOT "/etc/wlan_adapters.yaml"
+static YAMLCache adapters_yaml = YAML_CACHE_INIT(WLAN_ADAPTERS_YAML);
+
+// Link mode catalog (link_modes.c), reloaded when one of its files changes.
+static link_catalog_t link_catalog;
+static pthread_mutex_t link_catalog_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// "link_modes list|info|get_auto <kbps>|solve <kbps>", answered from link_catalog.
+static void link_modes_command(const char *args, char *response, size_t resp_size) {
+    int kbps = 0;
+    while (*args == ' ') args++;
+    pthread_mutex_lock(&link_catalog_lock);
+    if (link_catalog_refresh(&link_catalog) != 0) {
+        snprintf(response, resp_size, "Error: no link modes for adapter '%s'.", link_catalog.adapter);
+    } else if (strcmp(args, "list") == 0) {
+        if (link_catalog_list(&link_catalog, response, resp_size) != 0)
+            snprintf(response, resp_size, "Error: mode list too long.");
+    } else if (strcmp(args, "info") == 0) {
+        if (link_catalog_info(&link_catalog, response, resp_size) != 0)
+            snprintf(response, resp_size, "Error: info too long.");
+    } else if (sscanf(args, "get_auto %d", &kbps) == 1 && kbps > 0) {
+        link_catalog_get_auto(&link_catalog, current_bandwidth, kbps, response, resp_size);
+    } else if (sscanf(args, "solve %d", &kbps) == 1 && kbps > 0) {
+        link_choice_t choice;
+        if (link_catalog_solve(&link_catalog, current_bandwidth, kbps, &choice) != 0)
+            snprintf(response, resp_size, "No mode fits %d kbps at %d MHz", kbps, current_bandwidth);
+        else
+            link_choice_format(&link_catalog, &choice, response, resp_size);
+    } else {
+        snprintf(response, resp_size, "Invalid usage. Format: link_modes list|info|get_auto <kbps>|solve <kbps>");
+    }
+    pthread_mutex_unlock(&link_catalog_lock);
+}
 
+// Read a config value as a malloc'd string (caller frees), NULL if missing.
+// Values from /etc/wfb.yaml come from the in-memory cache; other files are
+// parsed on demand. Same output as "yaml-cli -i <file> -g <path>".
+char* read_yaml_value(const char* yaml_file, const char* yaml_path) {
     char buffer[BUF_SIZE];
-    if (!fgets(buffer, sizeof(buffer), fp)) { pclose(fp); return NULL; }
-    pclose(fp);
+    int rc;
+    if (strcmp(yaml_file, WFB_YAML) == 0) {
+        rc = yaml_cache_get(&wfb_yaml, yaml_path, buffer, sizeof(buffer));
+    } else {
+        YAMLNode *root = yaml_load(yaml_file);
+        rc = root ? yaml_get_value(root, yaml_path, buffer, sizeof(buffer)) : -1;
+        free_node(root);
+    }
+    if (rc != 0) return NULL;
 
     buffer[strcspn(buffer, "\r\n")] = 0;
-    char* result = malloc(strlen(buffer) + 1);
-    if (result) strcpy(result, buffer);
-    return result;
+    return strdup(buffer);
+}
+
+// ─── Native get/values queries ───
+// The OSD menus poll these constantly. Each entry answers exactly what the
+// matching air_man_cmd.sh branch prints (first line only, like the popen
+// fallback), but from the cached YAML instead of forking cli/yaml-cli.
+// Anything not listed here, or whose key is missing, still goes to the script.
+typedef enum {
+    Q_VALUE,    // the value as-is
+    Q_BOOL,     // "1" if the value is "true", else "0"
+    Q_CONST     // fixed reply in path
+} query_kind_t;
+
+typedef struct {
+    const char *cmd;
+    YAMLCache *file;
+    const char *path;
+    query_kind_t kind;
+} native_query_t;
+
+static const native_query_t native_queries[] = {
+    { "get air camera mirror",       &majestic_yaml, ".image.mirror",      Q_BOOL  },
+    { "get air camera flip",         &majestic_yaml, ".image.flip",        Q_BOOL  },
+    { "get air camera contrast",     &majestic_yaml, ".image.contrast",    Q_VALUE },
+    { "get air camera hue",          &majestic_yaml, ".image.hue",         Q_VALUE },
+    { "get air camera saturation",   &majestic_yaml, ".image.saturation",  Q_VALUE },
+    { "get air camera luminace",     &majestic_yaml, ".image.luminance",   Q_VALUE },
+    { "get air camera size",         &majestic_yaml, ".video0.size",       Q_VALUE },
+    { "get air camera fps",          &majestic_yaml, ".video0.fps",        Q_VALUE },
+    { "get air camera bitrate",      &majestic_yaml, ".video0.bitrate",    Q_VALUE },
+    { "get air camera codec",        &majestic_yaml, ".video0.codec",      Q_VALUE },
+    { "get air camera gopsize",      &majestic_yaml, ".video0.gopSize",    Q_VALUE },
+    { "get air camera rc_mode",      &majestic_yaml, ".video0.rcMode",     Q_VALUE },
+    { "get air camera rec_enable",   &majestic_yaml, ".records.enabled",   Q_BOOL  },
+    { "get air camera rec_split",    &majestic_yaml, ".records.split",     Q_VALUE },
+    { "get air camera rec_maxusage", &majestic_yaml, ".records.maxUsage",  Q_VALUE },
+    { "get air camera exposure",     &majestic_yaml, ".isp.exposure",      Q_VALUE },
+    { "get air camera antiflicker",  &majestic_yaml, ".isp.antiFlicker",   Q_VALUE },
+    { "get air camera sensor_file",  &majestic_yaml, ".isp.sensorConfig",  Q_VALUE },
+    { "get air camera fpv_enable",   &majestic_yaml, ".fpv.enabled",       Q_BOOL  },
+    { "get air camera noiselevel",   &majestic_yaml, ".fpv.noiseLevel",    Q_VALUE },
+    { "get air telemetry serial",    &wfb_yaml, ".telemetry.serial",       Q_VALUE },
+    { "get air telemetry router",    &wfb_yaml, ".telemetry.router",       Q_VALUE },
+    { "get air telemetry osd_fps",   &wfb_yaml, ".telemetry.osd_fps",      Q_VALUE },
+    { "get air wfbng power",         &wfb_yaml, ".wireless.txpower",       Q_VALUE },
+    { "get air wfbng width",         &wfb_yaml, ".wireless.width",         Q_VALUE },
+    { "get air wfbng mcs_index",     &wfb_yaml, ".broadcast.mcs_index",    Q_VALUE },
+    { "get air wfbng stbc",          &wfb_yaml, ".broadcast.stbc",         Q_VALUE },
+    { "get air wfbng ldpc",          &wfb_yaml, ".broadcast.ldpc",         Q_VALUE },
+    { "get air wfbng fec_k",         &wfb_yaml, ".broadcast.fec_k",        Q_VALUE },
+    { "get air wfbng fec_n",         &wfb_yaml, ".broadcast.fec_n",        Q_VALUE },
+    { "values air wfbng mcs_index",     NULL, "0 10",  Q_CONST },
+    { "values air wfbng fec_k",         NULL, "0 15",  Q_CONST },
+    { "values air wfbng fec_n",         NULL, "0 15",  Q_CONST },
+    { "values air camera contrast",     NULL, "0 100", Q_CONST },
+    { "values air camera hue",          NULL, "0 100", Q_CONST },
+    { "values air camera saturation",   NULL, "0 100", Q_CONST },
+    { "values air camera luminace",     NULL, "0 100", Q_CONST },
+    { "values air camera gopsize",      NULL, "0 10",  Q_CONST },
+    { "values air camera rec_split",    NULL, "0 60",  Q_CONST },
+    { "values air camera rec_maxusage", NULL, "0 100", Q_CONST },
+    { "values air camera exposure",     NULL, "5 50",  Q_CONST },
+    { "values air camera noiselevel",   NULL, "0 1",   Q_CONST },
+    { "values air telemetry osd_fps",   NULL, "0 60",  Q_CONST },
+};
+
+// Answer cmd from native_queries. Returns 0 if it did, -1 to fall back
+// to the script.
+static int native_query(const char *cmd, char *response, size_t resp_size) {
+    for (size_t i = 0; i < sizeof(native_queries) / sizeof(native_queries[0]); i++) {
+        const native_query_t *q = &native_queries[i];
+        if (strcmp(cmd, q->cmd) != 0) continue;
+        if (q->kind == Q_CONST) {
+            snprintf(response, resp_size, "%s", q->path);
+            return 0;
+        }
+        char value[BUF_SIZE] = "";
+        int rc = yaml_cache_get(q->file, q->path, value, sizeof(value));
+        value[strcspn(value, "\r\n")] = '\0';
+        if (q->kind == Q_BOOL) {
+            // the script prints 0 for a missing key too
+            snprintf(response, resp_size, "%d", rc == 0 && strcmp(value, "true") == 0);
+            return 0;
+        }
+        if (rc != 0) return -1;
+        snprintf(response, resp_size, "%s", value);
+        return 0;
+    }
+    return -1;
+}
+
+// ─── Result cache ───
+// Script fallback replies for read-only queries, keyed by command. "values"
+// lists (e.g. the iw-derived channel list) hardly ever change and live for
+// RESULT_TTL_VALUES; "get" replies live for RESULT_TTL_GET and are dropped as
+// soon as any config or restart command finishes (see worker_main). The
+// generation counter keeps a read that raced with such a command from
+// storing its stale reply. TTLs run on CLOCK_MONOTONIC: the drone boots at
+// 1970 and its wall clock is stepped later.
+#define RESULT_CACHE_SLOTS 32
+#define RESULT_TTL_VALUES 300000   // ms
+#define RESULT_TTL_GET 10000       // ms
+
+static struct {
+    pthread_mutex_t lock;
+    struct {
+        char key[128];
+        char value[BUF_SIZE];
+        long long expires;      // monotonic ms, 0 = free slot
+    } e[RESULT_CACHE_SLOTS];
+    unsigned generation;
+    unsigned long hits, misses, invalidations;
+} rcache = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static int result_ttl(const char *cmd) {
+    if (strncmp(cmd, "values ", 7) == 0) return RESULT_TTL_VALUES;
+    if (strncmp(cmd, "get ", 4) == 0) return RESULT_TTL_GET;
+    return 0;
+}
+
+static int result_cache_get(const char *cmd, char *buf, size_t size) {
+    if (!result_ttl(cmd)) return -1;
+    long long now = monotonic_ms();
+    int rc = -1;
+    pthread_mutex_lock(&rcache.lock);
+    for (int i = 0; i < RESULT_CACHE_SLOTS; i++) {
+        if (rcache.e[i].expires > now && strcmp(rcache.e[i].key, cmd) == 0) {
+            snprintf(buf, size, "%s", rcache.e[i].value);
+            rc = 0;
+            break;
+        }
+    }
+    if (rc == 0) rcache.hits++; else rcache.misses++;
+    pthread_mutex_unlock(&rcache.lock);
+    return rc;
+}
+
+static unsigned result_cache_generation(void) {
+    pthread_mutex_lock(&rcache.lock);
+    unsigned gen = rcache.generation;
+    pthread_mutex_unlock(&rcache.lock);
+    return gen;
+}
+
+// Store value for cmd unless an invalidation happened since gen was taken.
+static void result_cache_put(const char *cmd, const char *value, unsigned gen) {
+    int ttl = result_ttl(cmd);
+    if (!ttl || strlen(cmd) >= sizeof(rcache.e[0].key)) return;
+    long long now = monotonic_ms();
+    pthread_mutex_lock(&rcache.lock);
+    if (gen == rcache.generation) {
+        int slot = 0;   // free or expired slot, else the one expiring first
+        for (int i = 0; i < RESULT_CACHE_SLOTS; i++) {
+            if (rcache.e[i].expires <= now || strcmp(rcache.e[i].key, cmd) == 0) { slot = i; break; }
+            if (rcache.e[i].expires < rcache.e[slot].expires) slot = i;
+        }
+        snprintf(rcache.e[slot].key, sizeof(rcache.e[slot].key), "%s", cmd);
+        snprintf(rcache.e[slot].value, sizeof(rcache.e[slot].value), "%s", value);
+        rcache.e[slot].expires = now + ttl;
+    }
+    pthread_mutex_unlock(&rcache.lock);
+}
+
+// Config may have changed: drop every "get" reply.
+static void result_cache_invalidate(void) {
+    pthread_mutex_lock(&rcache.lock);
+    rcache.generation++;
+    rcache.invalidations++;
+    for (int i = 0; i < RESULT_CACHE_SLOTS; i++)
+        if (strncmp(rcache.e[i].key, "get ", 4) == 0) rcache.e[i].expires = 0;
+    pthread_mutex_unlock(&rcache.lock);
+}
+
+static void result_cache_stats(char *response, size_t resp_size) {
+    long long now = monotonic_ms();
+    pthread_mutex_lock(&rcache.lock);
+    int used = 0;
+    for (int i = 0; i < RESULT_CACHE_SLOTS; i++)
+        if (rcache.e[i].expires > now) used++;
+    snprintf(response, resp_size,
+             "result cache: hits=%lu misses=%lu invalidations=%lu entries=%d/%d",
+             rcache.hits, rcache.misses, rcache.invalidations, used, RESULT_CACHE_SLOTS);
+    pthread_mutex_unlock(&rcache.lock);
 }
 
 // Command functions: return 0 on success, non-zero on failure
 int cmd_start_alink(void) {
-    return system("/usr/bin/alink_drone > /dev/null &");
+    return run_child(AIR_MAN_SYSROOT "/usr/bin/alink_drone > /dev/null &");
 }
 
 int cmd_stop_alink(void) {
-    return system("killall alink_drone");
+    return run_child("killall alink_drone");
 }
 
 int cmd_restart_alink(void) {
-    char *value = read_yaml_value("/etc/wfb.yaml", ".wireless.link_control");
+    char *value = read_yaml_value(WFB_YAML, ".wireless.link_control");
     if (!value) {
         if (verbose) printf("[DEBUG] Could not read link_control\n");
         return -1;
     }
     int ret = -1;
     if (strcmp(value, "alink") == 0) {
-        ret = system("killall alink_drone");
+        ret = run_child("killall alink_drone");
         if (ret == 0)
-            ret = system("/usr/bin/alink_drone > /dev/null &");
+            ret = run_child(AIR_MAN_SYSROOT "/usr/bin/alink_drone > /dev/null &");
     } else if (verbose) {
         printf("[DEBUG] alink not enabled in YAML (link_control=%s)\n", value);
     }
@@ -276,67 +616,896 @@ int cmd_restart_alink(void) {
 }
 
 int cmd_restart_majestic(void) {
-    return system("killall -HUP majestic");
+    if (majestic_reload() == 0) return 0;
+    return run_child("killall -HUP majestic");
 }
 
 int cmd_restart_wfb(void) {
-    return system("sh -c \"wifibroadcast stop && sleep 1 && wifibroadcast start && sleep 2 && curl localhost/request/idr\"");
+    return run_child("sh -c \"wifibroadcast stop && sleep 1 && wifibroadcast start && sleep 2 && curl localhost/request/idr\"");
 }
 
 int cmd_restart_msposd(void) {
-    return system("wifibroadcast restart osd");
+    return run_child("wifibroadcast restart osd");
 }
 
-// Helper to revert channel change on timeout
-void revert_channel_change(int orig_channel) {
-    char syscmd[128];
-	
-	strcpy(bw_string,
-       current_bandwidth == 10 ? "10MHz" :
-       current_bandwidth == 40 ? "HT40+" :
-       current_bandwidth == 80 ? "80MHz" : "");
+// Crop currently in effect ("nocrop" when none), so a mode change knows
+// whether the VPE pipeline has to be rebuilt. Guarded by video_mode_lock.
+static char applied_crop[64] = "nocrop";
+static pthread_mutex_t video_mode_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Older versions kept the crop as a "#set by alink_manager" block in
+// /etc/rc.local. Move such a crop to PRECROP_STATE_FILE and drop the block,
+// once, so rc.local and air_man don't both apply it at boot.
+static int migrate_rc_local_crop(void) {
+    FILE *f = fopen(RC_LOCAL, "r");
+    if (!f) return -1;
+    char line[256];
+    int found = 0;
+    while (fgets(line, sizeof(line), f)) {
+        char *p = strstr(line, "echo setprecrop ");
+        char *e = p ? strstr(p, " >") : NULL;
+        if (!e) continue;
+        p += strlen("echo setprecrop ");
+        snprintf(applied_crop, sizeof(applied_crop), "%.*s", (int)(e - p), p);
+        found = 1;
+    }
+    fclose(f);
+    if (!found || precrop_state_save(applied_crop) != 0) return -1;
+    if (run_child("sed -i '/^#set by alink_manager/,/echo setprecrop/d' " RC_LOCAL) != 0)
+        fprintf(stderr, "[WARN] could not remove the old precrop block from /etc/rc.local\n");
+    return 0;
+}
 
-    snprintf(syscmd, sizeof(syscmd), "iw dev wlan0 set channel %d %s", orig_channel, bw_string);
-    if (verbose) printf("[DEBUG] Reverting channel: %s\n", syscmd);
-    system(syscmd);
-    current_channel = orig_channel;
-    printf("Channel change timed out. Reverted to channel %d.\n", orig_channel);
+static void load_applied_crop(void) {
+    if (precrop_state_load(applied_crop, sizeof(applied_crop)) != 0)
+        migrate_rc_local_crop();
 }
 
-// Background thread to check for pending channel confirmations
-void *confirmation_checker(void *arg) {
-    while (1) {
-        sleep(1);
-        time_t now = time(NULL);
-        pthread_mutex_lock(&pending.lock);
-        if (pending.pending_channel_flag && difftime(now, pending.pending_channel_time) >= CONFIRM_TIMEOUT) {
-            if (verbose) printf("[DEBUG] Channel change confirmation timed out\n");
-            revert_channel_change(pending.original_channel);
-            pending.pending_channel_flag = 0;
+// ─── Video pipeline restarts ───
+// A majestic reload tears the VPE down and builds it again, which drops the
+// pre-crop. Rather than sleeping a fixed time, the restart thread polls for
+// the old pipeline to go away and the new one to come up (mi_vpe0's channel
+// table, or majestic's HTTP API where there is no such node), applies the
+// crop the moment it is up and records how long that took, for
+// "pipeline_status". Up only counts once down was seen: majestic's API keeps
+// answering through a reload, and a slow teardown still shows the old
+// channels. When down is not seen the crop waits PIPELINE_SETTLE_MS, as the
+// old fixed sleep did, and the restart is reported as not measured.
+// Restarts run one at a time.
+
+#define PIPELINE_POLL_MS 20
+#define PIPELINE_SETTLE_MS 3000         // for the old pipeline to go away, or assumed gone
+#define PIPELINE_UP_TIMEOUT_MS 10000    // for the new one to come up
+#define PIPELINE_BOOT_TIMEOUT_MS 30000  // majestic may start after air_man
+
+static pthread_mutex_t pipeline_lock = PTHREAD_MUTEX_INITIALIZER;        // held for a whole restart
+static pthread_mutex_t pipeline_stats_lock = PTHREAD_MUTEX_INITIALIZER;  // held briefly, for:
+static int pipeline_restarts;
+static char pipeline_last[128] = "";
+
+typedef struct {
+    int boot;                   // only wait for majestic's first start
+    char crop[64];
+} pipeline_job_t;
+
+static int pipeline_up(void) {
+    int n = mi_vpe_channels();
+    if (n >= 0) return n > 0;
+    return majestic_http_get("/api/v1/config.json", NULL, 0) == 200;
+}
+
+// Poll until pipeline_up() == want. Returns 0, or -1 after timeout_ms.
+static int pipeline_wait(int want, long timeout_ms) {
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while (pipeline_up() != want) {
+        if (elapsed_ms(&t0) >= timeout_ms) return -1;
+        usleep(PIPELINE_POLL_MS * 1000);
+    }
+    return 0;
+}
+
+static void *pipeline_main(void *arg) {
+    pipeline_job_t *j = arg;
+    struct timespec t0;
+    char last[sizeof(pipeline_last)];
+    int up, down = 1;
+
+    pthread_mutex_lock(&pipeline_lock);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (j->boot) {
+        up = pipeline_wait(1, PIPELINE_BOOT_TIMEOUT_MS);
+    } else {
+        cmd_restart_majestic();
+        // Only mi_vpe0 shows the teardown; the HTTP API never goes down.
+        down = mi_vpe_channels() >= 0 && pipeline_wait(0, PIPELINE_SETTLE_MS) == 0;
+        if (!down) {
+            long left = PIPELINE_SETTLE_MS - elapsed_ms(&t0);
+            if (left > 0) usleep(left * 1000);
         }
-        pthread_mutex_unlock(&pending.lock);
+        up = pipeline_wait(1, PIPELINE_UP_TIMEOUT_MS);
+    }
+    long ms = elapsed_ms(&t0);
+    if (down) stats_record(j->boot ? "pipeline_boot" : "pipeline_reload", STAT_EXEC, ms * 1000LL);
+    if (child_runs) stats_record("pipeline_reload", STAT_CHILD, child_us);
+
+    int n = snprintf(last, sizeof(last), "%s: %s%s %ldms",
+                     j->boot ? "boot" : "reload", down ? "" : "down not observed, ",
+                     up != 0 ? "not up after" : down ? "up after" : "assumed up after", ms);
+    if (strcmp(j->crop, "nocrop") != 0) {
+        // Apply it even after a timeout; the old sleep did no better.
+        int rc = mi_set_precrop(j->crop);
+        if (rc == 0)
+            snprintf(last + n, sizeof(last) - n, ", crop %s applied", j->crop);
+        else
+            snprintf(last + n, sizeof(last) - n, ", setprecrop %s: %s", j->crop, strerror(-rc));
     }
+    pthread_mutex_unlock(&pipeline_lock);
+    printf("[INFO] Video pipeline %s\n", last);
+    pthread_mutex_lock(&pipeline_stats_lock);
+    pipeline_restarts += !j->boot;
+    snprintf(pipeline_last, sizeof(pipeline_last), "%s", last);
+    pthread_mutex_unlock(&pipeline_stats_lock);
+
+    if (!j->boot) {
+        cmd_restart_msposd();
+        sleep(1);
+        cmd_restart_alink();
+    }
+    free(j);
     return NULL;
 }
 
-/*
- * update_precrop_rc_local_simple() updates /etc/rc.local for precrop settings.
- */
-void update_precrop_rc_local_simple(const char *crop) {
-    char cmd[512];
-    snprintf(cmd, sizeof(cmd),
-             "sed -i '/^#set by alink_manager/,/echo setprecrop/{/echo setprecrop/{N; s/\\n[[:space:]]*//;};d}' /etc/rc.local");
-    if (system(cmd) != 0) {
-        fprintf(stderr, "Error removing old precrop blocks.\n");
+static void start_pipeline_thread(int boot, const char *crop) {
+    pipeline_job_t *j = calloc(1, sizeof(*j));
+    if (!j) return;
+    j->boot = boot;
+    snprintf(j->crop, sizeof(j->crop), "%s", crop);
+    pthread_t t;
+    if (pthread_create(&t, NULL, pipeline_main, j) != 0) {
+        perror("pthread_create");
+        free(j);
         return;
     }
-    if (strcmp(crop, "nocrop") == 0) return;
-    snprintf(cmd, sizeof(cmd),
-             "sed -i '/^[[:space:]]*exit 0[[:space:]]*$/i\\\n"
-             "#set by alink_manager\\\n"
-             "sleep 2\\\n"
-             "echo setprecrop %s > /proc/mi_modules/mi_vpe/mi_vpe0\\\n' /etc/rc.local", crop);
-    if (system(cmd) != 0) fprintf(stderr, "Error inserting new precrop block.\n");
+    pthread_detach(t);
+}
+
+// Restart majestic in the background and re-apply the crop once it is up.
+static void reload_video_pipeline(const char *crop) {
+    start_pipeline_thread(0, crop);
+}
+
+static void pipeline_status(char *response, size_t resp_size) {
+    pthread_mutex_lock(&pipeline_stats_lock);
+    if (pipeline_last[0])
+        snprintf(response, resp_size, "Majestic reloads: %d, last %s", pipeline_restarts, pipeline_last);
+    else
+        snprintf(response, resp_size, "No video pipeline restart yet.");
+    pthread_mutex_unlock(&pipeline_stats_lock);
+}
+
+// Apply a video mode with as little disruption as possible:
+//   1) persist size/fps/exposure to majestic.yaml in one atomic write
+//   2) if only fps/exposure changed, push them live via /api/v1/set
+//   3) otherwise (size or crop changed, or the API failed) reload majestic
+// The response starts with echo (air_man_gs reads the fps from field 2)
+// followed by the time each step took.
+static void apply_video_mode(const VideoMode *m, const char *echo,
+                             char *response, size_t resp_size) {
+    char fps[16], exposure[16];
+    char cur_size[32] = "", cur_fps[16] = "", cur_exposure[16] = "";
+    struct timespec t0;
+    const char *why = NULL;
+
+    pthread_mutex_lock(&video_mode_lock);
+    snprintf(fps, sizeof(fps), "%d", m->fps);
+    snprintf(exposure, sizeof(exposure), "%d", m->exposure);
+    yaml_cache_get(&majestic_yaml, ".video0.size", cur_size, sizeof(cur_size));
+    yaml_cache_get(&majestic_yaml, ".video0.fps", cur_fps, sizeof(cur_fps));
+    yaml_cache_get(&majestic_yaml, ".isp.exposure", cur_exposure, sizeof(cur_exposure));
+    if (strcmp(cur_size, m->size) != 0) why = "size";
+    else if (strcmp(applied_crop, m->crop) != 0) why = "crop";
+
+    int n = snprintf(response, resp_size, "%s |", echo);
+#define APPEND(...) do { \
+        if (n >= 0 && (size_t)n < resp_size) n += snprintf(response + n, resp_size - n, __VA_ARGS__); \
+    } while (0)
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    const char *paths[] = { ".video0.size", ".video0.fps", ".isp.exposure" };
+    const char *values[] = { m->size, fps, exposure };
+    if (yaml_cache_set_many(&majestic_yaml, paths, values, 3) != 0) {
+        // No readable majestic.yaml: let majestic's own cli write it.
+        char cmdline[256];
+        snprintf(cmdline, sizeof(cmdline),
+                 "cli -s .video0.size %s; cli -s .video0.fps %d; cli -s .isp.exposure %d",
+                 m->size, m->fps, m->exposure);
+        run_child(cmdline);
+        APPEND(" persist(cli) %ldms", elapsed_ms(&t0));
+    } else {
+        APPEND(" persist %ldms", elapsed_ms(&t0));
+    }
+
+    if (!why) {
+        char query[128] = "";
+        if (strcmp(cur_fps, fps) != 0)
+            snprintf(query, sizeof(query), "video0.fps=%s", fps);
+        if (strcmp(cur_exposure, exposure) != 0)
+            snprintf(query + strlen(query), sizeof(query) - strlen(query),
+                     "%sisp.exposure=%s", query[0] ? "&" : "", exposure);
+        if (!query[0]) {
+            APPEND(", unchanged");
+        } else {
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            if (majestic_set(query) == 0)
+                APPEND(", live %s %ldms", query, elapsed_ms(&t0));
+            else
+                why = "api failed";
+        }
+    }
+    if (why) {
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        reload_video_pipeline(m->crop);
+        if (strcmp(applied_crop, m->crop) != 0 && precrop_state_save(m->crop) != 0)
+            fprintf(stderr, "[WARN] failed to save crop to %s\n", PRECROP_STATE_FILE);
+        snprintf(applied_crop, sizeof(applied_crop), "%s", m->crop);
+        APPEND(", reload (%s) %ldms", why, elapsed_ms(&t0));
+    }
+#undef APPEND
+    pthread_mutex_unlock(&video_mode_lock);
+}
+
+// ─── Confirm-or-revert transactions ───
+// change_* commands make a setting live right away and open a transaction
+// for it. "confirm [<kind>]" persists the new value; if no confirm arrives
+// within CONFIRM_TIMEOUT the previous value is re-applied. There is at most
+// one transaction per kind (a second change keeps the original value to
+// revert to), so the deadlines are kept in a small array and one timerfd in
+// the event loop is armed for the earliest of them.
+
+typedef enum {
+    TXN_CHANNEL, TXN_BANDWIDTH, TXN_MCS, TXN_TXPOWER, TXN_VIDEO_MODE, TXN_KINDS
+} txn_kind_t;
+
+typedef struct {
+    const char *name;
+    int (*apply)(const char *value);    // make value live; 0 on success
+    int (*persist)(const char *value);  // store a confirmed value; 0 on success
+} txn_ops_t;
+
+typedef struct {
+    int active;
+    struct timespec deadline;           // CLOCK_MONOTONIC
+    char old_value[128];                // re-applied on timeout
+    char new_value[128];
+} txn_t;
+
+static txn_t txns[TXN_KINDS];
+static pthread_mutex_t txn_lock = PTHREAD_MUTEX_INITIALIZER;
+static int txn_tfd = -1;
+
+// Compiled /etc/txprofiles.conf and the row last applied by "txprofile";
+// -1 once something else changed the link. Both under txn_lock.
+static txprofile_table_t txprofiles;
+static int txprofile_applied = -1;
+
+// Tune wlan0 over nl80211; fall back to iw if the driver rejects the request.
+static int set_channel_bw(int channel, int bandwidth) {
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int rc = wlan_set_channel(WLAN_IFNAME, channel, bandwidth);
+    if (verbose || rc != 0)
+        fprintf(rc ? stderr : stdout, "[%s] nl80211 set channel %d width %d: %s (%ld us)\n",
+                rc ? "WARN" : "DEBUG", channel, bandwidth, rc ? strerror(-rc) : "ok", elapsed_us(&t0));
+    if (rc == 0) return 0;
+
+    char syscmd[128];
+    strcpy(bw_string,
+           bandwidth == 10 ? "10MHz" :
+           bandwidth == 40 ? "HT40+" :
+           bandwidth == 80 ? "80MHz" : "");
+    snprintf(syscmd, sizeof(syscmd), "iw dev %s set channel %d %s", WLAN_IFNAME, channel, bw_string);
+    if (verbose) printf("[DEBUG] %s\n", syscmd);
+    return run_child(syscmd) == 0 ? 0 : -1;
+}
+
+// mBm for power index idx at the current MCS, from the adapter's
+// tx_power table in wlan_adapters.yaml (as tx_manager.sh looks it up).
+static int txpower_index_to_mbm(int idx, int *mbm) {
+    char adapter[64], path[160], list[256];
+    if (yaml_cache_get(&wfb_yaml, ".wireless.wlan_adapter", adapter, sizeof(adapter)) != 0)
+        return -1;
+    snprintf(path, sizeof(path), ".profiles.%s.tx_power.mcs%d", adapter, current_mcs);
+    if (yaml_cache_get(&adapters_yaml, path, list, sizeof(list)) != 0) return -1;
+    char *p = list + (list[0] == '[');
+    for (int i = 0; *p; i++) {
+        char *end;
+        long v = strtol(p, &end, 10);
+        if (end == p) return -1;
+        if (i == idx) { *mbm = v; return 0; }
+        p = end + strspn(end, " ,");
+    }
+    return -1;
+}
+
+static int txn_apply_channel(const char *v) {
+    if (set_channel_bw(atoi(v), current_bandwidth) != 0) return -1;
+    current_channel = atoi(v);
+    return 0;
+}
+
+static int txn_apply_bandwidth(const char *v) {
+    if (set_channel_bw(current_channel, atoi(v)) != 0) return -1;
+    current_bandwidth = atoi(v);
+    return 0;
+}
+
+static int txn_apply_txpower(const char *v) {
+    int mbm, rc = -1;
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (txpower_index_to_mbm(atoi(v), &mbm) == 0) {
+        rc = wlan_set_txpower(WLAN_IFNAME, mbm);
+        if (verbose || rc != 0)
+            fprintf(rc ? stderr : stdout, "[%s] nl80211 set txpower %d mBm: %s (%ld us)\n",
+                    rc ? "WARN" : "DEBUG", mbm, rc ? strerror(-rc) : "ok", elapsed_us(&t0));
+    }
+    if (rc != 0) {
+        char syscmd[128];
+        snprintf(syscmd, sizeof(syscmd), "tx_manager.sh set_tx_power %d >/dev/null 2>&1", atoi(v));
+        if (run_child(syscmd) != 0) return -1;
+    }
+    current_txpower = atoi(v);
+    return 0;
+}
+
+// The TX power for an index depends on the MCS (wlan_adapters.yaml), so the
+// current index is re-applied after the MCS changes, as tx_manager.sh
+// set_tx_power --mcs does. Falls back to that script if wfb_tx's control
+// port does not answer.
+static int txn_apply_mcs(const char *v) {
+    char syscmd[128];
+    int rc = wfb_tx_set_mcs(atoi(v));
+    if (rc == 0) {
+        current_mcs = atoi(v);
+        snprintf(syscmd, sizeof(syscmd), "%d", current_txpower);
+        return txn_apply_txpower(syscmd);
+    }
+    if (rc > 0) {
+        fprintf(stderr, "[WARN] wfb_tx set_radio mcs %d: %s\n", atoi(v), strerror(rc));
+        return -1;
+    }
+    snprintf(syscmd, sizeof(syscmd), "tx_manager.sh set_tx_power %d --mcs %d >/dev/null 2>&1",
+             current_txpower, atoi(v));
+    if (run_child(syscmd) != 0) return -1;
+    current_mcs = atoi(v);
+    return 0;
+}
+
+static int txn_apply_video_mode(const char *v) {
+    const VideoMode *m = find_video_mode(v);
+    if (!m) return -1;
+    char out[BUF_SIZE];
+    apply_video_mode(m, m->spec, out, sizeof(out));
+    if (verbose) printf("[DEBUG] video mode %s: %s\n", v, out);
+    snprintf(current_video_mode, sizeof(current_video_mode), "%s", v);
+    return 0;
+}
+
+static int persist_wfb(const char *path, const char *v) {
+    if (verbose) printf("[DEBUG] Persisting %s %s\n", path, v);
+    if (yaml_cache_set(&wfb_yaml, path, v) == 0) return 0;
+    fprintf(stderr, "[WARN] failed to persist %s to %s\n", path, WFB_YAML);
+    return -1;
+}
+static int txn_persist_channel(const char *v)   { return persist_wfb(".wireless.channel", v); }
+static int txn_persist_bandwidth(const char *v) { return persist_wfb(".wireless.width", v); }
+static int txn_persist_mcs(const char *v)       { return persist_wfb(".broadcast.mcs_index", v); }
+static int txn_persist_txpower(const char *v)   { return persist_wfb(".wireless.txpower", v); }
+
+static int txn_persist_video_mode(const char *v) {
+    FILE *f = fopen(MODE_CURRENT_FILE, "w");
+    if (!f) {
+        if (verbose) fprintf(stderr, "[WARN] failed to write current mode file\n");
+        return -1;
+    }
+    fprintf(f, "%s\n", v);
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+static const txn_ops_t txn_ops[TXN_KINDS] = {
+    [TXN_CHANNEL]    = { "channel",    txn_apply_channel,    txn_persist_channel },
+    [TXN_BANDWIDTH]  = { "bandwidth",  txn_apply_bandwidth,  txn_persist_bandwidth },
+    [TXN_MCS]        = { "mcs",        txn_apply_mcs,        txn_persist_mcs },
+    [TXN_TXPOWER]    = { "txpower",    txn_apply_txpower,    txn_persist_txpower },
+    [TXN_VIDEO_MODE] = { "video_mode", txn_apply_video_mode, txn_persist_video_mode },
+};
+
+static void txn_current_value(txn_kind_t kind, char *buf, size_t size) {
+    switch (kind) {
+    case TXN_CHANNEL:    snprintf(buf, size, "%d", current_channel); break;
+    case TXN_BANDWIDTH:  snprintf(buf, size, "%d", current_bandwidth); break;
+    case TXN_MCS:        snprintf(buf, size, "%d", current_mcs); break;
+    case TXN_TXPOWER:    snprintf(buf, size, "%d", current_txpower); break;
+    default:             snprintf(buf, size, "%s", current_video_mode); break;
+    }
+}
+
+// Arm the timerfd for the earliest active deadline (or disarm it).
+// Caller holds txn_lock.
+static void txn_rearm_locked(void) {
+    struct itimerspec its = {0};
+    for (int k = 0; k < TXN_KINDS; k++) {
+        if (!txns[k].active) continue;
+        const struct timespec *d = &txns[k].deadline;
+        if ((its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) ||
+            d->tv_sec < its.it_value.tv_sec ||
+            (d->tv_sec == its.it_value.tv_sec && d->tv_nsec < its.it_value.tv_nsec))
+            its.it_value = *d;
+    }
+    if (txn_tfd >= 0) timerfd_settime(txn_tfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+// Apply value for kind and open (or extend) its transaction.
+// Returns 0 on success, -1 if the change could not be applied.
+static int txn_change(txn_kind_t kind, const char *value) {
+    pthread_mutex_lock(&txn_lock);
+    txn_t *t = &txns[kind];
+    char old_value[sizeof(t->old_value)];
+    if (t->active) snprintf(old_value, sizeof(old_value), "%s", t->old_value);
+    else txn_current_value(kind, old_value, sizeof(old_value));
+
+    if (txn_ops[kind].apply(value) != 0) {
+        pthread_mutex_unlock(&txn_lock);
+        return -1;
+    }
+    if (kind == TXN_BANDWIDTH || kind == TXN_MCS || kind == TXN_TXPOWER) txprofile_applied = -1;
+    if (!old_value[0]) {
+        // Nothing known to go back to: treat the change as final.
+        txn_ops[kind].persist(value);
+        pthread_mutex_unlock(&txn_lock);
+        return 0;
+    }
+    t->active = 1;
+    snprintf(t->old_value, sizeof(t->old_value), "%s", old_value);
+    snprintf(t->new_value, sizeof(t->new_value), "%s", value);
+    clock_gettime(CLOCK_MONOTONIC, &t->deadline);
+    t->deadline.tv_sec += CONFIRM_TIMEOUT;
+    txn_rearm_locked();
+    pthread_mutex_unlock(&txn_lock);
+    return 0;
+}
+
+// Persist and close kind's transaction. Returns -1 if none was pending.
+static int txn_confirm(txn_kind_t kind, char *value, size_t size) {
+    pthread_mutex_lock(&txn_lock);
+    txn_t *t = &txns[kind];
+    if (!t->active) {
+        pthread_mutex_unlock(&txn_lock);
+        return -1;
+    }
+    t->active = 0;
+    txn_ops[kind].persist(t->new_value);
+    if (value) snprintf(value, size, "%s", t->new_value);
+    txn_rearm_locked();
+    pthread_mutex_unlock(&txn_lock);
+    return 0;
+}
+
+// Re-apply an expired transaction's old value. Runs on a worker.
+static void txn_revert(txn_kind_t kind, const char *old_value) {
+    pthread_mutex_lock(&txn_lock);
+    if (txns[kind].active) {
+        // A newer change started after the deadline; let it revert to the
+        // original value instead. old_value came through a job's command
+        // buffer, so bound the copy to what a txn holds.
+        snprintf(txns[kind].old_value, sizeof(txns[kind].old_value), "%.*s",
+                 (int)sizeof(txns[kind].old_value) - 1, old_value);
+    } else if (txn_ops[kind].apply(old_value) == 0) {
+        stats_count(STAT_REVERTS, 1);
+        if (kind == TXN_BANDWIDTH || kind == TXN_MCS || kind == TXN_TXPOWER) txprofile_applied = -1;
+        printf("%c%s change timed out. Reverted to %s %s.\n",
+               toupper((unsigned char)txn_ops[kind].name[0]), txn_ops[kind].name + 1,
+               txn_ops[kind].name, old_value);
+    } else {
+        fprintf(stderr, "[WARN] failed to revert %s to %s\n", txn_ops[kind].name, old_value);
+    }
+    pthread_mutex_unlock(&txn_lock);
+}
+
+static txn_kind_t txn_kind_by_name(const char *name) {
+    for (int k = 0; k < TXN_KINDS; k++)
+        if (strcmp(name, txn_ops[k].name) == 0) return k;
+    return TXN_KINDS;
+}
+
+// One line per pending transaction: "<kind> <old> -> <new> <ms left>ms".
+static void txn_describe(char *response, size_t resp_size) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    size_t n = 0;
+    response[0] = '\0';
+    pthread_mutex_lock(&txn_lock);
+    for (int k = 0; k < TXN_KINDS && n < resp_size; k++) {
+        if (!txns[k].active) continue;
+        long left = (txns[k].deadline.tv_sec - now.tv_sec) * 1000 +
+                    (txns[k].deadline.tv_nsec - now.tv_nsec) / 1000000;
+        n += snprintf(response + n, resp_size - n, "%s %s -> %s %ldms\n",
+                      txn_ops[k].name, txns[k].old_value, txns[k].new_value, left);
+    }
+    pthread_mutex_unlock(&txn_lock);
+    if (!response[0]) snprintf(response, resp_size, "No pending changes.");
+}
+
+// ─── Link profile transaction ───
+// "set_link_profile <kbps> [mode <name>] [fec <k>/<n>] [txpower <idx>]"
+// does in one job what auto_bitrate.sh does through datalink_manager.sh
+// --set: encoder bitrate, channel width, radio (MCS/GI), FEC and TX power.
+// The live steps run first, in an order that never leaves the encoder above
+// what the new link carries (a lower bitrate goes first, a higher one last,
+// instead of the script's fixed 3000 kbps + sleep 0.5), and each is timed.
+// Only when all of them succeeded are wfb.yaml and majestic.yaml written,
+// one batched write each. A failed step or write undoes the steps already
+// done, in reverse. Without a mode the solver (link_catalog_solve) picks
+// mode and FEC for the bitrate at the current width.
+
+typedef enum { LP_BITRATE, LP_WIDTH, LP_RADIO, LP_FEC, LP_TXPOWER, LP_STEPS } lp_step_t;
+static const char *const lp_step_names[LP_STEPS] = { "bitrate", "width", "radio", "fec", "txpower" };
+
+typedef struct {
+    int kbps;                   // 0 = unknown
+    int bandwidth, mcs, short_gi;
+    int fec_k, fec_n;
+    int txpower;
+} link_profile_t;
+
+static int wfb_yaml_int(const char *path, int def) {
+    char v[32];
+    return yaml_cache_get(&wfb_yaml, path, v, sizeof(v)) == 0 && v[0] ? atoi(v) : def;
+}
+
+// The live link as air_man knows it. Caller holds txn_lock.
+static void link_profile_current(link_profile_t *p) {
+    char v[32] = "";
+    p->kbps = yaml_cache_get(&majestic_yaml, ".video0.bitrate", v, sizeof(v)) == 0 ? atoi(v) : 0;
+    p->bandwidth = current_bandwidth;
+    p->mcs = current_mcs;
+    v[0] = '\0';
+    yaml_cache_get(&wfb_yaml, ".wireless.gi", v, sizeof(v));
+    p->short_gi = strcmp(v, "short") == 0;
+    if (wfb_tx_get_fec(&p->fec_k, &p->fec_n) != 0) {
+        p->fec_k = wfb_yaml_int(".broadcast.fec_k", 8);
+        p->fec_n = wfb_yaml_int(".broadcast.fec_n", 12);
+    }
+    p->txpower = current_txpower;
+}
+
+// Make one step of p live. Caller holds txn_lock.
+static int link_profile_apply(lp_step_t step, const link_profile_t *p) {
+    char args[128];
+    wfb_radio_t radio;
+    switch (step) {
+    case LP_BITRATE:
+        snprintf(args, sizeof(args), "video0.bitrate=%d", p->kbps);
+        return majestic_set(args);
+    case LP_WIDTH:
+        if (set_channel_bw(current_channel, p->bandwidth) != 0) return -1;
+        current_bandwidth = p->bandwidth;
+        return 0;
+    case LP_RADIO:
+        // STBC, LDPC and VHT stay as wfb_tx has them.
+        if (wfb_tx_get_radio(&radio) != 0) return -1;
+        radio.bandwidth = p->bandwidth;
+        radio.short_gi = p->short_gi;
+        radio.mcs_index = p->mcs;
+        if (wfb_tx_set_radio(&radio) != 0) return -1;
+        current_mcs = p->mcs;
+        return 0;
+    case LP_FEC:
+        return wfb_tx_set_fec(p->fec_k, p->fec_n) == 0 ? 0 : -1;
+    case LP_TXPOWER:
+        // The mBm for an index depends on the MCS, so this runs after LP_RADIO.
+        snprintf(args, sizeof(args), "%d", p->txpower);
+        return txn_apply_txpower(args);
+    default:
+        return -1;
+    }
+}
+
+// Write p's settings to wfb.yaml and majestic.yaml. Caller holds txn_lock.
+static int link_profile_persist(const link_profile_t *p) {
+    char width[8], mcs[8], fec_k[8], fec_n[8], txpower[8], kbps[16];
+    snprintf(width, sizeof(width), "%d", p->bandwidth);
+    snprintf(mcs, sizeof(mcs), "%d", p->mcs);
+    snprintf(fec_k, sizeof(fec_k), "%d", p->fec_k);
+    snprintf(fec_n, sizeof(fec_n), "%d", p->fec_n);
+    snprintf(txpower, sizeof(txpower), "%d", p->txpower);
+    snprintf(kbps, sizeof(kbps), "%d", p->kbps);
+    const char *paths[] = { ".wireless.width", ".broadcast.mcs_index", ".wireless.gi",
+                            ".broadcast.fec_k", ".broadcast.fec_n", ".wireless.txpower" };
+    const char *values[] = { width, mcs, p->short_gi ? "short" : "long", fec_k, fec_n, txpower };
+    if (yaml_cache_set_many(&wfb_yaml, paths, values, 6) != 0) return -1;
+    if (p->kbps && yaml_cache_set(&majestic_yaml, ".video0.bitrate", kbps) != 0) return -1;
+    return 0;
+}
+
+// Undo done[0..n) in reverse, TX power last since it follows the MCS.
+static void link_profile_rollback(const lp_step_t *done, int n, const link_profile_t *old) {
+    int txpower = 0;
+    stats_count(STAT_REVERTS, 1);
+    for (int i = n - 1; i >= 0; i--) {
+        if (done[i] == LP_TXPOWER) { txpower = 1; continue; }
+        if (done[i] == LP_BITRATE && !old->kbps) continue;
+        if (link_profile_apply(done[i], old) != 0)
+            fprintf(stderr, "[WARN] failed to roll back %s\n", lp_step_names[done[i]]);
+    }
+    if (txpower && link_profile_apply(LP_TXPOWER, old) != 0)
+        fprintf(stderr, "[WARN] failed to roll back txpower\n");
+}
+
+// Fill *p from the command arguments; the reply explains a -1.
+static int link_profile_parse(const char *args, link_profile_t *p, char *mode_name, size_t name_size,
+                              char *response, size_t resp_size) {
+    char buf[BUF_SIZE], *save, *tok;
+    int have_mode = 0, have_fec = 0, txpower = -1;
+    snprintf(buf, sizeof(buf), "%s", args);
+    tok = strtok_r(buf, " ", &save);
+    p->kbps = tok ? atoi(tok) : 0;
+    while ((tok = strtok_r(NULL, " ", &save))) {
+        char *val = strtok_r(NULL, " ", &save);
+        if (!val) break;
+        if (strcmp(tok, "mode") == 0) {
+            snprintf(mode_name, name_size, "%s", val);
+            have_mode = 1;
+        } else if (strcmp(tok, "fec") == 0 && sscanf(val, "%d/%d", &p->fec_k, &p->fec_n) == 2) {
+            have_fec = 1;
+        } else if (strcmp(tok, "txpower") == 0) {
+            txpower = atoi(val);
+        } else {
+            p->kbps = 0;
+            break;
+        }
+    }
+    if (p->kbps <= 0) {
+        snprintf(response, resp_size, "Invalid usage. Format: set_link_profile <kbps> "
+                 "[mode <name>] [fec <k>/<n>] [txpower <idx>]");
+        return -1;
+    }
+    if (have_fec && (p->fec_k < 1 || p->fec_n < p->fec_k)) {
+        snprintf(response, resp_size, "Error: bad FEC %d/%d.", p->fec_k, p->fec_n);
+        return -1;
+    }
+    if (txpower >= 0) p->txpower = txpower;
+
+    pthread_mutex_lock(&link_catalog_lock);
+    int rc = -1;
+    if (link_catalog_refresh(&link_catalog) != 0) {
+        snprintf(response, resp_size, "Error: no link modes for adapter '%s'.", link_catalog.adapter);
+    } else if (have_mode) {
+        const link_mode_t *m = link_mode_find(&link_catalog, mode_name);
+        if (!m) {
+            snprintf(response, resp_size, "Error: unknown link mode '%s'.", mode_name);
+        } else {
+            p->mcs = m->mcs;
+            p->bandwidth = m->bandwidth_mhz;
+            p->short_gi = m->short_gi;
+            rc = 0;
+        }
+    } else {
+        link_choice_t c;
+        if (link_catalog_solve(&link_catalog, current_bandwidth, p->kbps, &c) != 0) {
+            snprintf(response, resp_size, "Error: no mode fits %d kbps at %d MHz.", p->kbps, current_bandwidth);
+        } else {
+            const link_mode_t *m = &link_catalog.modes[c.mode];
+            snprintf(mode_name, name_size, "%s", m->name);
+            p->mcs = m->mcs;
+            p->bandwidth = m->bandwidth_mhz;
+            p->short_gi = m->short_gi;
+            if (!have_fec) {
+                p->fec_k = c.fec_k;
+                p->fec_n = c.fec_n;
+            }
+            rc = 0;
+        }
+    }
+    pthread_mutex_unlock(&link_catalog_lock);
+    return rc;
+}
+
+// The reply lists each live step with its time, then "glitch <ms>ms" (first
+// live change to last) and the time of the config writes.
+static void set_link_profile(const char *args, char *response, size_t resp_size) {
+    link_profile_t old, p;
+    char mode_name[32] = "";
+    lp_step_t steps[LP_STEPS + 1];
+    int n_steps = 0;
+
+    pthread_mutex_lock(&txn_lock);
+    if (txns[TXN_BANDWIDTH].active || txns[TXN_MCS].active || txns[TXN_TXPOWER].active) {
+        pthread_mutex_unlock(&txn_lock);
+        snprintf(response, resp_size, "Error: a link change is pending; confirm it first.");
+        return;
+    }
+    link_profile_current(&old);
+    p = old;
+    if (link_profile_parse(args, &p, mode_name, sizeof(mode_name), response, resp_size) != 0) {
+        pthread_mutex_unlock(&txn_lock);
+        return;
+    }
+
+    int lower_first = !old.kbps || p.kbps < old.kbps;
+    if (lower_first) steps[n_steps++] = LP_BITRATE;
+    if (p.bandwidth != old.bandwidth) steps[n_steps++] = LP_WIDTH;
+    if (p.bandwidth != old.bandwidth || p.mcs != old.mcs || p.short_gi != old.short_gi)
+        steps[n_steps++] = LP_RADIO;
+    if (p.fec_k != old.fec_k || p.fec_n != old.fec_n) steps[n_steps++] = LP_FEC;
+    if (p.txpower != old.txpower || p.mcs != old.mcs) steps[n_steps++] = LP_TXPOWER;
+    if (!lower_first && p.kbps != old.kbps) steps[n_steps++] = LP_BITRATE;
+
+    int n = snprintf(response, resp_size, "Link profile %s fec=%d/%d txpower=%d bitrate=%d |",
+                     mode_name, p.fec_k, p.fec_n, p.txpower, p.kbps);
+#define APPEND(...) do { \
+        if (n >= 0 && (size_t)n < resp_size) n += snprintf(response + n, resp_size - n, __VA_ARGS__); \
+    } while (0)
+
+    struct timespec t0, ts;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (n_steps) txprofile_applied = -1;
+    for (int i = 0; i < n_steps; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        if (link_profile_apply(steps[i], &p) != 0) {
+            link_profile_rollback(steps, i, &old);
+            snprintf(response, resp_size, "Error: %s step failed; rolled back in %ldms.",
+                     lp_step_names[steps[i]], elapsed_ms(&t0));
+            pthread_mutex_unlock(&txn_lock);
+            return;
+        }
+        APPEND("%s %s %ldms", i ? "," : "", lp_step_names[steps[i]], elapsed_ms(&ts));
+    }
+    if (!n_steps) APPEND(" unchanged");
+    APPEND(" | glitch %ldms", elapsed_ms(&t0));
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    if (link_profile_persist(&p) != 0) {
+        link_profile_persist(&old);
+        link_profile_rollback(steps, n_steps, &old);
+        snprintf(response, resp_size, "Error: could not write the config; rolled back in %ldms.",
+                 elapsed_ms(&t0));
+        pthread_mutex_unlock(&txn_lock);
+        return;
+    }
+    APPEND(", persist %ldms", elapsed_ms(&ts));
+#undef APPEND
+    pthread_mutex_unlock(&txn_lock);
+}
+
+// ─── Transmit profiles ───
+// "txprofile <score>" applies the txprofiles.conf row for an alink link
+// score, issuing only what differs from the row applied last (see
+// txprofiles.h): GI/MCS/bandwidth as one wfb_tx set_radio, FEC as one
+// set_fec and bitrate/GOP/ROI/qpDelta as one majestic /api/v1/set request,
+// instead of one alink.conf template command each. As with set_link_profile
+// a lower bitrate goes out before the radio change and a higher one after.
+// The Pwr column is used only when alink.conf has allow_set_power=1 and
+// use_0_to_4_txpower=0, scaled to mBm by alink's TX power factor as its
+// "iw set txpower fixed {power}" would be (here over nl80211);
+// otherwise the power index is kept and re-applied for a new MCS.
+// "txprofile" alone shows the row last applied.
+
+// Integer key=value from alink.conf, def if missing.
+static int alink_conf_int(const char *key, int def) {
+    FILE *f = fopen(ALINK_CONFIG_FILE, "r");
+    if (!f) return def;
+    char line[256];
+    size_t len = strlen(key);
+    int v = def;
+    while (fgets(line, sizeof(line), f))
+        if (strncmp(line, key, len) == 0 && line[len] == '=') {
+            v = atoi(line + len + 1);
+            break;
+        }
+    fclose(f);
+    return v;
+}
+
+// alink's "TX Power Factor": Pwr times this is the mBm it hands to
+// powerCommandTemplate. Negative for rtl88XXau, whose driver reads the
+// level inverted. Found once, from /proc/modules, as alink does.
+static int alink_tx_factor(void) {
+    static int factor;
+    if (factor) return factor;
+    factor = 50;
+    FILE *f = fopen(AIR_MAN_SYSROOT "/proc/modules", "r");
+    if (f) {
+        char line[256];
+        while (fgets(line, sizeof(line), f))
+            if (strstr(line, "88XXau")) {
+                factor = -100;
+                break;
+            }
+        fclose(f);
+    }
+    printf("[INFO] TX Power Factor: %d\n", factor);
+    return factor;
+}
+
+// Issue the mask fields of p. Caller holds txn_lock.
+static int txprofile_apply(const tx_profile_t *p, unsigned mask, int lower_first) {
+    char query[256] = "";
+    size_t n = 0;
+#define QUERY(...) do { \
+        if (n < sizeof(query)) n += snprintf(query + n, sizeof(query) - n, __VA_ARGS__); \
+    } while (0)
+    if (mask & TXP_BITRATE) QUERY("video0.bitrate=%d&", p->bitrate);
+    if (mask & TXP_GOP) QUERY("video0.gopSize=%d&", p->gop);
+    if (mask & TXP_ROI) QUERY("fpv.roiQp=%s&", p->roi_qp);
+    if (mask & TXP_QP_DELTA) QUERY("video0.qpDelta=%d&", p->qp_delta);
+#undef QUERY
+    if (n) query[n - 1] = '\0';
+
+    if (n && lower_first && majestic_set(query) != 0) return -1;
+    if (mask & (TXP_GI | TXP_MCS | TXP_BANDWIDTH)) {
+        wfb_radio_t radio;
+        if (wfb_tx_get_radio(&radio) != 0) return -1;
+        radio.short_gi = p->short_gi;
+        radio.mcs_index = p->mcs;
+        radio.bandwidth = p->bandwidth;
+        if (wfb_tx_set_radio(&radio) != 0) return -1;
+    }
+    if ((mask & TXP_FEC) && wfb_tx_set_fec(p->fec_k, p->fec_n) != 0) return -1;
+    if (alink_conf_int("allow_set_power", 1) && !alink_conf_int("use_0_to_4_txpower", 1)) {
+        if ((mask & TXP_POWER) && wlan_set_txpower(WLAN_IFNAME, p->power * alink_tx_factor()) != 0) return -1;
+    } else if ((mask & TXP_MCS) && p->mcs != current_mcs) {
+        char idx[16];
+        current_mcs = p->mcs;
+        snprintf(idx, sizeof(idx), "%d", current_txpower);
+        if (txn_apply_txpower(idx) != 0) return -1;
+    }
+    if (mask & TXP_MCS) current_mcs = p->mcs;
+    if (n && !lower_first && majestic_set(query) != 0) return -1;
+    return 0;
+}
+
+static void txprofile_command(const char *args, char *response, size_t resp_size) {
+    char err[256], fields[128];
+    int score;
+    while (*args == ' ') args++;
+    pthread_mutex_lock(&txn_lock);
+    int rc = txprofiles_refresh(&txprofiles, err, sizeof(err));
+    if (rc < 0) {
+        snprintf(response, resp_size, "Error: %s.", err);
+    } else if (!*args) {
+        if (txprofile_applied < 0) {
+            snprintf(response, resp_size, "No profile applied.");
+        } else {
+            const tx_profile_t *p = &txprofiles.p[txprofile_applied];
+            snprintf(response, resp_size,
+                     "Profile %d (%d-%d): gi=%s mcs=%d fec=%d/%d bitrate=%d gop=%d power=%d roiQP=%s bw=%d qpDelta=%d",
+                     txprofile_applied, p->lo, p->hi, p->short_gi ? "short" : "long", p->mcs,
+                     p->fec_k, p->fec_n, p->bitrate, p->gop, p->power, p->roi_qp, p->bandwidth, p->qp_delta);
+        }
+    } else if (sscanf(args, "%d", &score) != 1) {
+        snprintf(response, resp_size, "Invalid usage. Format: txprofile [<score>]");
+    } else {
+        if (rc == 1) txprofile_applied = -1;       // rows changed under us
+        int to = txprofiles_find(&txprofiles, score);
+        const tx_profile_t *p = &txprofiles.p[to];
+        unsigned mask = txprofiles_diff(&txprofiles, txprofile_applied, to);
+        int lower_first = txprofile_applied < 0 || p->bitrate < txprofiles.p[txprofile_applied].bitrate;
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        txprofiles_mask_str(mask, fields, sizeof(fields));
+        if (txprofile_apply(p, mask, lower_first) != 0) {
+            txprofile_applied = -1;                 // partly applied: resend everything next time
+            snprintf(response, resp_size, "Error: profile %d (%d-%d) failed while setting %s.",
+                     to, p->lo, p->hi, fields);
+        } else {
+            txprofile_applied = to;
+            snprintf(response, resp_size, "Profile %d (%d-%d): %s | %ldms",
+                     to, p->lo, p->hi, mask ? fields : "unchanged", elapsed_ms(&t0));
+        }
+    }
+    pthread_mutex_unlock(&txn_lock);
 }
 
 // Process a command from a client and fill the response.
@@ -379,105 +1548,124 @@ void process_command(const char *cmd, char *response, size_t resp_size) {
     } else if (strncmp(command, "change_channel", 14) == 0) {
         int new_channel;
         if (sscanf(command, "change_channel %d", &new_channel) == 1) {
-            char syscmd[128];
-
-			sleep(1);
-
-			strcpy(bw_string,
-				current_bandwidth == 10 ? "10MHz" :
-				current_bandwidth == 40 ? "HT40+" :
-				current_bandwidth == 80 ? "80MHz" : "");
-
-			snprintf(syscmd, sizeof(syscmd), "iw dev wlan0 set channel %d %s", new_channel, bw_string);
-            if (verbose) printf("[DEBUG] %s\n", syscmd);
-            if (system(syscmd) == 0) {
-                pthread_mutex_lock(&pending.lock);
-                pending.original_channel = current_channel;
-                pending.pending_channel = new_channel;
-                pending.pending_channel_flag = 1;
-                pending.pending_channel_time = time(NULL);
-                pthread_mutex_unlock(&pending.lock);                
-            } else {
+            char value[16];
+            snprintf(value, sizeof(value), "%d", new_channel);
+            if (txn_change(TXN_CHANNEL, value) == 0)
+                snprintf(response, resp_size,
+                         "Channel change to %d applied; confirm within %d s or it reverts.",
+                         new_channel, CONFIRM_TIMEOUT);
+            else
                 snprintf(response, resp_size, "Failed to change channel.");
-            }
         } else {
             snprintf(response, resp_size, "Invalid channel command.");
         }
 
-    } else if (strncmp(command, "confirm_channel_change", 22) == 0) {
-        pthread_mutex_lock(&pending.lock);
-        if (pending.pending_channel_flag) {
-            current_channel = pending.pending_channel;
-            char persist[128];
-            snprintf(persist, sizeof(persist),
-                     "yaml-cli -i /etc/wfb.yaml -s .wireless.channel %d", current_channel);
-            if (verbose) printf("[DEBUG] %s\n", persist);
-            system(persist);
-            pending.pending_channel_flag = 0;
-            pthread_mutex_unlock(&pending.lock);
-            snprintf(response, resp_size,
-                     "Channel change confirmed. Now on channel %d.", current_channel);
+    } else if (strncmp(command, "change_bandwidth", 16) == 0) {
+        int bw;
+        if (sscanf(command, "change_bandwidth %d", &bw) == 1 &&
+            (bw == 10 || bw == 20 || bw == 40 || bw == 80)) {
+            char value[16];
+            snprintf(value, sizeof(value), "%d", bw);
+            if (txn_change(TXN_BANDWIDTH, value) == 0)
+                snprintf(response, resp_size,
+                         "Bandwidth change to %d MHz applied; confirm within %d s or it reverts.",
+                         bw, CONFIRM_TIMEOUT);
+            else
+                snprintf(response, resp_size, "Failed to change bandwidth.");
         } else {
-            pthread_mutex_unlock(&pending.lock);
-            snprintf(response, resp_size,
-                     "No pending channel change to confirm.");
+            snprintf(response, resp_size, "Invalid usage. Format: change_bandwidth <10|20|40|80>");
         }
 
+    } else if (strncmp(command, "change_mcs", 10) == 0 ||
+               strncmp(command, "change_txpower", 14) == 0) {
+        int is_mcs = command[7] == 'm';
+        int v;
+        if (sscanf(command + (is_mcs ? 10 : 14), "%d", &v) == 1 &&
+            v >= 0 && v <= (is_mcs ? 7 : 10)) {
+            char value[16];
+            snprintf(value, sizeof(value), "%d", v);
+            if (txn_change(is_mcs ? TXN_MCS : TXN_TXPOWER, value) == 0)
+                snprintf(response, resp_size,
+                         "%s set to %d; confirm within %d s or it reverts.",
+                         is_mcs ? "MCS" : "TX power", v, CONFIRM_TIMEOUT);
+            else
+                snprintf(response, resp_size, "Failed to change %s.", is_mcs ? "MCS" : "TX power");
+        } else {
+            snprintf(response, resp_size, "Invalid usage. Format: %s",
+                     is_mcs ? "change_mcs <0-7>" : "change_txpower <0-10>");
+        }
+
+    } else if (strncmp(command, "change_video_mode", 17) == 0) {
+        char *start = command + 17;
+        while (*start == ' ' || *start == '\t') start++;
+        char *end = start + strlen(start) - 1;
+        if (end > start && ((*start == '\'' && *end == '\'') || (*start == '"' && *end == '"'))) {
+            *end = '\0';
+            start++;
+        }
+        const VideoMode *m = find_video_mode(start);
+        if (!m)
+            snprintf(response, resp_size, "Mode not found: %s", start);
+        else if (txn_change(TXN_VIDEO_MODE, m->name) == 0)
+            snprintf(response, resp_size, "%s | confirm within %d s or it reverts",
+                     m->spec, CONFIRM_TIMEOUT);
+        else
+            snprintf(response, resp_size, "Failed to change video mode.");
+
+    } else if (strncmp(command, "confirm_channel_change", 22) == 0 ||
+               (strncmp(command, "confirm", 7) == 0 && (command[7] == ' ' || command[7] == '\0'))) {
+        // confirm_channel_change is kept as an alias for "confirm channel"
+        const char *arg = command[7] == '_' ? "channel" : command + 7;
+        while (*arg == ' ') arg++;
+        if (strcmp(arg, "channel") == 0) {
+            char value[16];
+            if (txn_confirm(TXN_CHANNEL, value, sizeof(value)) == 0)
+                snprintf(response, resp_size,
+                         "Channel change confirmed. Now on channel %s.", value);
+            else
+                snprintf(response, resp_size,
+                         "No pending channel change to confirm.");
+        } else if (*arg) {
+            txn_kind_t k = txn_kind_by_name(arg);
+            char value[128];
+            if (k == TXN_KINDS)
+                snprintf(response, resp_size, "Unknown change type: %s", arg);
+            else if (txn_confirm(k, value, sizeof(value)) == 0)
+                snprintf(response, resp_size, "%s change confirmed: %s.", txn_ops[k].name, value);
+            else
+                snprintf(response, resp_size, "No pending %s change to confirm.", txn_ops[k].name);
+        } else {
+            size_t n = 0;
+            response[0] = '\0';
+            for (int k = 0; k < TXN_KINDS; k++) {
+                char value[128];
+                if (txn_confirm(k, value, sizeof(value)) == 0 && n < resp_size)
+                    n += snprintf(response + n, resp_size - n, "%s%s=%s",
+                                  n ? ", " : "Confirmed ", txn_ops[k].name, value);
+            }
+            if (!n) snprintf(response, resp_size, "No pending changes to confirm.");
+        }
+
+    } else if (strcmp(command, "pending") == 0) {
+        txn_describe(response, resp_size);
+
     } else if (strncmp(command, "set_video_mode", 14) == 0) {
 		const char *args = command + 15;  // everything after "set_video_mode "
 		snprintf(response, resp_size, "%s", args);
 
-		char size[32], crop[128];
-		int new_fps, new_exp;
-
-		if (sscanf(args, "%31s %d %d '%127[^']'", size, &new_fps, &new_exp, crop) == 4 ||
-			sscanf(args, "%31s %d %d \"%127[^\"]\"", size, &new_fps, &new_exp, crop) == 4) {
-        
-			// Apply new settings
-			char cmdline[256];
-			snprintf(cmdline, sizeof(cmdline), "cli -s .video0.size %s", size);
-			system(cmdline);
-			snprintf(cmdline, sizeof(cmdline), "cli -s .video0.fps %d", new_fps);
-			system(cmdline);
-			snprintf(cmdline, sizeof(cmdline), "cli -s .isp.exposure %d", new_exp);
-			system(cmdline);
-
-			// Fork for background restart + crop
-			if (fork() == 0) {
-				system("killall -HUP majestic");
-
-				if (strcmp(crop, "nocrop") != 0) {
-					sleep(3);
-					char c2[256];
-					snprintf(c2, sizeof(c2),
-							"echo setprecrop %s > /proc/mi_modules/mi_vpe/mi_vpe0", crop);
-					system(c2);
-				}
-
-				update_precrop_rc_local_simple(crop);
-				cmd_restart_msposd();
-				sleep(1);
-				cmd_restart_alink();
-				_exit(0);
-			}
-		}
-	
-		else {
+		VideoMode m = {0};
+		if (parse_video_mode_spec(args, &m) == 0) {
+			apply_video_mode(&m, args, response, resp_size);
+		} else {
             snprintf(response, resp_size,
                      "Invalid set_video_mode command. Format: set_video_mode <size> <fps> <exposure> '<crop>'");
-				}
+		}
 
 		} else if (strncmp(command, "get_all_video_modes", 19) == 0) {
-		if (video_mode_count == 0) {
-			snprintf(response, resp_size, "No video modes loaded.");
-		} else {
-			response[0] = '\0';
-			for (int i = 0; i < video_mode_count; ++i) {
-				strncat(response, video_modes[i].name, resp_size - strlen(response) - 2);
-				strncat(response, "\n", resp_size - strlen(response) - 2);
-			}
-		}
-		
+		// The event loop replies with video_modes_response() directly; this
+		// copy only serves callers with a fixed buffer.
+		snprintf(response, resp_size, "%s", video_modes_response());
+
 		} else if (strncmp(command, "set_simple_video_mode", 21) == 0) {
     // 1) Extract the quoted mode name
     char *arg = command + 21;
@@ -489,51 +1677,29 @@ void process_command(const char *cmd, char *response, size_t resp_size) {
         *end = '\0';
         start++;
     }
-    char mode_name[128];
-    strncpy(mode_name, start, sizeof(mode_name)-1);
-    mode_name[sizeof(mode_name)-1] = '\0';
 
-    // 2) Find the matching entry in our loaded table
-    int idx = -1;
-    for (int i = 0; i < video_mode_count; i++) {
-        if (strcmp(mode_name, video_modes[i].name) == 0) {
-            idx = i;
-            break;
-        }
-    }
+    // 2) Look it up in the name index
+    const VideoMode *m = find_video_mode(start);
 
-    if (idx >= 0) {
-        // 3) Build the full set_video_mode command
-        char full_cmd[512];
-        snprintf(full_cmd, sizeof(full_cmd),
-                 
-				 "set_video_mode %s", video_modes[idx].command);
+    if (m) {
+        // 3) Apply it; the reply echoes the mode spec like set_video_mode
+        apply_video_mode(m, m->spec, response, resp_size);
 
-        // 4) Call existing logic to apply it and fill `response`
-        process_command(full_cmd, response, resp_size);
-
-        // 5) Persist the simple‐mode name
-        FILE *f = fopen("/etc/sensors/mode_current", "w");
-        if (f) {
-            fprintf(f, "%s\n", mode_name);
-            fclose(f);
-        } else {
-            // optional warning, but do not override `response`
-            if (verbose) fprintf(stderr,
-                "[WARN] failed to write current mode file\n");
-        }
+        // 4) Persist the simple‐mode name
+        snprintf(current_video_mode, sizeof(current_video_mode), "%s", m->name);
+        txn_persist_video_mode(m->name);
 
     } else {
         // not found in our table
         snprintf(response, resp_size,
-                 "Mode not found: %s", mode_name);
+                 "Mode not found: %s", start);
     }
 
 
 
 	    }
 		else if (strcmp(command, "get_current_video_mode") == 0) {
-		FILE *f = fopen("/etc/sensors/mode_current", "r");
+		FILE *f = fopen(MODE_CURRENT_FILE, "r");
 		if (f) {
 			if (fgets(response, resp_size, f)) {
 				// Strip trailing newline if present
@@ -552,11 +1718,36 @@ void process_command(const char *cmd, char *response, size_t resp_size) {
 
 
 
+		else if (strncmp(command, "link_modes", 10) == 0) {
+			link_modes_command(command + 10, response, resp_size);
+		}
+
+		else if (strncmp(command, "set_link_profile ", 17) == 0) {
+			set_link_profile(command + 17, response, resp_size);
+		}
+
+		else if (strncmp(command, "txprofile", 9) == 0 && (command[9] == ' ' || !command[9])) {
+			txprofile_command(command + 9, response, resp_size);
+		}
+
+		else if (strcmp(command, "pipeline_status") == 0) {
+			pipeline_status(response, resp_size);
+		}
+
+		else if (strncmp(command, "set_sensor_fps", 14) == 0) {
+			int fps, rc;
+			if (sscanf(command, "set_sensor_fps %d", &fps) != 1 || fps <= 0)
+				snprintf(response, resp_size, "Invalid usage. Format: set_sensor_fps <fps>");
+			else if ((rc = mi_set_fps(fps)) != 0)
+				snprintf(response, resp_size, "Error: setfps %d: %s", fps, strerror(-rc));
+			else
+				snprintf(response, resp_size, "Sensor fps set to %d.", fps);
+		}
+
 		else if (strncmp(command, "set_alink_power", 15) == 0) {
 			int lvl;
 			if (sscanf(command, "set_alink_power %d", &lvl) == 1) {
-				char resp[BUF_SIZE];
-				int sock_status = airman_send_set_power(lvl);
+				int sock_status = alink_set_power(lvl);
 				int cfg_status  = update_alink_config_power(lvl);
 
 				if (sock_status == 0 && cfg_status == 0) {
@@ -577,15 +1768,54 @@ void process_command(const char *cmd, char *response, size_t resp_size) {
 				snprintf(response, resp_size,
 						"Invalid usage. Format: set_alink_power <0–10>");
 			}
+		}
+
+		else if (strcmp(command, "alink_status") == 0) {
+			char text[BUF_SIZE / 2];
+			int st = alink_get_status(text, sizeof(text));
+			if (st == 0)
+				snprintf(response, resp_size, "%s", text[0] ? text : "alink OK");
+			else
+				snprintf(response, resp_size, "alink_status: %s", alink_status_str(st));
+		}
+
+		else if (strcmp(command, "get_radio") == 0) {
+			wfb_radio_t r;
+			int rc = wfb_tx_get_radio(&r);
+			if (rc == 0)
+				snprintf(response, resp_size,
+						"stbc=%d\nldpc=%d\nshort_gi=%d\nbandwidth=%d\nmcs_index=%d\nvht_mode=%d\nvht_nss=%d",
+						r.stbc, r.ldpc, r.short_gi, r.bandwidth, r.mcs_index, r.vht_mode, r.vht_nss);
+			else
+				snprintf(response, resp_size, "Error: wfb_tx get_radio: %s",
+						rc < 0 ? "no reply" : strerror(rc));
+		}
 
+		else if (strcmp(command, "get_fec") == 0) {
+			int k, n;
+			int rc = wfb_tx_get_fec(&k, &n);
+			if (rc == 0)
+				snprintf(response, resp_size, "k=%d\nn=%d", k, n);
+			else
+				snprintf(response, resp_size, "Error: wfb_tx get_fec: %s",
+						rc < 0 ? "no reply" : strerror(rc));
+		}
 
+		else if (strcmp(command, "cache_stats") == 0) {
+			result_cache_stats(response, resp_size);
+		} else if (result_cache_get(command, response, resp_size) == 0) {
+			if (verbose) printf("[DEBUG] Cached reply for: %s\n", command);
 		} else {
+			unsigned gen = result_cache_generation();
 			char s[BUF_SIZE+128];
 			// redirect stderr into stdout so popen() sees syntax errors too
 			snprintf(s, sizeof(s), "%s %s 2>&1", script, command);
 			if (verbose) printf("[DEBUG] Running fallback: %s\n", s);
 
-			FILE *pipe = popen(s, "r");
+			struct timespec t0;
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			stats_count(STAT_POPENS, 1);
+			FILE *pipe = child_popen(s);
 			if (pipe) {
 				char out[BUF_SIZE];
 				response[0] = '\0';
@@ -597,11 +1827,15 @@ void process_command(const char *cmd, char *response, size_t resp_size) {
 					response[resp_size-1] = '\0';
 				}
 				// now check exit status
-				int status = pclose(pipe);
+				int status = child_pclose(pipe);
+				child_us += elapsed_us(&t0);
+				child_runs++;
 				if (response[0]=='\0' && WIFEXITED(status) && WEXITSTATUS(status)!=0) {
 					snprintf(response, resp_size,
 							"Error: script exited with code %d",
 							WEXITSTATUS(status));
+				} else if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+					result_cache_put(command, response, gen);
 				}
 			} else {
 				snprintf(response, resp_size,
@@ -612,77 +1846,936 @@ void process_command(const char *cmd, char *response, size_t resp_size) {
 }
 
 
-// Thread function to handle each client connection.
-void *client_handler(void *arg) {
-    int client_fd = *(int*)arg; free(arg);
-    char buffer[BUF_SIZE];
-    int n = read(client_fd, buffer, sizeof(buffer)-1);
-    if (n <= 0) {
-        close(client_fd);
-        pthread_exit(NULL);
+// ─── Event loop ───
+// A single thread owns the listening socket and all client connections.
+// Commands that only touch in-memory state are answered inline; anything
+// that shells out or sleeps is handed to a small fixed worker pool and the
+// result is posted back to the loop through an eventfd. The pool is split
+// into lanes (see lanes[]) so a storm of restarts or slow script calls can't
+// starve plain reads: each lane has its own threads and queue bound, and a
+// command whose lane is full is refused with a busy reply. Transaction
+// deadlines (see "Confirm-or-revert transactions") fire on a timerfd.
+//
+// A connection normally carries one command and is closed after the reply.
+// If the first line is "session", it stays open instead and every following
+// line is a command. A line of the form "@<id> <command>" is tagged: it may
+// run alongside other tagged commands and its reply can arrive out of order.
+// Untagged commands run one at a time in the order they were sent. Each
+// session reply is framed as
+//     @<id>          (tagged commands only)
+//     <reply lines>  (lines starting with '.' get an extra '.')
+//     .
+// "quit" ends the session once all outstanding replies have been sent.
+
+typedef struct conn {
+    int fd;
+    char in[BUF_SIZE];
+    size_t in_len;
+    char *out;
+    size_t out_len, out_off, out_cap;
+    int session;            // persistent, newline-delimited command stream
+    int inflight;           // commands running on workers
+    int ordered_busy;       // an untagged session command is running
+    int closing;            // close once output drains and nothing is in flight
+    int read_done;          // peer shut down its side
+    int dead;               // peer gone while in flight; free when jobs return
+    int subscribe_ms;       // > 0: push telemetry every subscribe_ms
+    long long next_push;    // monotonic ms of the next telemetry push
+    time_t last_active;
+    struct conn *next_closed;
+} conn_t;
+
+#define SESSION_MAX_INFLIGHT 8     // tagged commands per session
+#define SESSION_IDLE_TIMEOUT 60    // seconds
+#define SESSION_TAG_LEN 16
+#define CONN_OUT_MAX (64*1024)     // cap on unsent output per connection
+#define STATS_REPLY_MAX (16*1024)  // "stats" reply
+#define ACK_DRAIN_TIMEOUT_MS 1000  // max wait for an ACK to reach the GS before a hop
+#define SUBSCRIBE_DEFAULT_MS 1000  // telemetry interval when none is given
+#define SUBSCRIBE_MIN_MS 100
+#define SUBSCRIBE_MAX_MS 60000
+#define SUBSCRIBE_SLACK_MS 20      // push early rather than skip a tick
+#define TELE_ALINK_REFRESH_MS 1000 // alink status is re-read at most this often
+#define TELE_ALINK_BACKOFF_MAX_MS 16000 // longest wait after alink failed to answer
+
+typedef enum {
+    LANE_FAST,          // reads: get/values queries, status
+    LANE_CONFIG,        // writes: set/change/confirm, script fallback
+    LANE_DISRUPTIVE,    // restarts of majestic, wfb, msposd, alink
+    LANES
+} lane_t;
+
+typedef struct job {
+    conn_t *conn;                  // NULL for internal jobs
+    void (*run)(struct job *);     // internal jobs: run instead of process_command
+    int arg;
+    int drain_fd;                  // >= 0: wait until the peer has ACKed our output
+    const char *name;              // stats key of an internal job
+    struct timespec queued;        // when it entered its lane
+
+    char tag[SESSION_TAG_LEN];     // empty for untagged commands
+    char cmd[BUF_SIZE];
+    char response[BUF_SIZE];
+    struct job *next;
+} job_t;
+
+static int epfd = -1;
+static int done_efd = -1;
+static int tele_tfd = -1;
+static int tele_sampling;       // a telemetry sample job is queued or running
+static int stats_tfd = -1;
+static int stats_dump_s;        // -j/--stats-json: write STATS_JSON_PATH every N s, 0 = off
+static conn_t *conns[MAX_CONNS];
+// Closed connections are freed after the current epoll batch, since a
+// later event in the same batch may still point at them.
+static conn_t *closed_conns;
+
+static struct lane {
+    const char *name;
+    int threads;
+    int queue_len;           // queued client jobs before "busy"
+    job_t *head, *tail;      // pending jobs
+    int len;
+    pthread_cond_t cond;
+} lanes[LANES] = {
+    [LANE_FAST]       = { "fast",       2, 16, .cond = PTHREAD_COND_INITIALIZER },
+    [LANE_CONFIG]     = { "config",     1,  8, .cond = PTHREAD_COND_INITIALIZER },
+    [LANE_DISRUPTIVE] = { "disruptive", 1,  1, .cond = PTHREAD_COND_INITIALIZER },
+};
+
+static struct {
+    job_t *done;             // completed jobs, LIFO, drained by the loop
+    pthread_mutex_t lock;    // guards done and every lane's queue
+} workq = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+// Wait until everything written to a TCP socket has been ACKed by the peer
+// (SIOCOUTQ drops to 0), so a channel hop can't strand the ACK we just sent.
+static void wait_output_acked(int fd, int timeout_ms) {
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int queued;
+    while (ioctl(fd, SIOCOUTQ, &queued) == 0 && queued > 0 &&
+           elapsed_us(&t0) < timeout_ms * 1000L)
+        usleep(1000);
+    if (verbose) printf("[DEBUG] reply drained in %ld us\n", elapsed_us(&t0));
+}
+
+static void *worker_main(void *arg) {
+    struct lane *l = arg;
+    for (;;) {
+        pthread_mutex_lock(&workq.lock);
+        while (!l->head) pthread_cond_wait(&l->cond, &workq.lock);
+        job_t *j = l->head;
+        l->head = j->next;
+        if (!l->head) l->tail = NULL;
+        l->len--;
+        pthread_mutex_unlock(&workq.lock);
+
+        const char *key = j->run ? j->name : j->cmd;
+        if (j->drain_fd >= 0) {
+            wait_output_acked(j->drain_fd, ACK_DRAIN_TIMEOUT_MS);
+            close(j->drain_fd);
+        }
+        stats_record(key, STAT_QUEUE, elapsed_us(&j->queued));
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        child_us = child_runs = 0;
+        if (j->run) j->run(j);
+        else process_command(j->cmd, j->response, sizeof(j->response));
+        stats_record(key, STAT_EXEC, elapsed_us(&t0));
+        if (child_runs) stats_record(key, STAT_CHILD, child_us);
+        // Only reads run in the fast lane; anything else may have changed
+        // what a cached "get" would return.
+        if (l != &lanes[LANE_FAST]) result_cache_invalidate();
+
+        pthread_mutex_lock(&workq.lock);
+        j->next = workq.done;
+        workq.done = j;
+        pthread_mutex_unlock(&workq.lock);
+        uint64_t one = 1;
+        if (write(done_efd, &one, sizeof(one)) < 0) perror("eventfd write");
+    }
+    return NULL;
+}
+
+// Which lane a client command runs in. Unknown commands go to the script,
+// which may be slow, so only known reads get the fast lane.
+static lane_t command_lane(const char *cmd) {
+    if (strncmp(cmd, "restart_", 8) == 0 || strncmp(cmd, "start_alink", 11) == 0 ||
+        strncmp(cmd, "stop_alink", 10) == 0)
+        return LANE_DISRUPTIVE;
+    if (strncmp(cmd, "get ", 4) == 0 || strncmp(cmd, "values ", 7) == 0 ||
+        strncmp(cmd, "get_", 4) == 0 || strcmp(cmd, "pending") == 0 ||
+        strcmp(cmd, "alink_status") == 0 || strncmp(cmd, "link_modes", 10) == 0)
+        return LANE_FAST;
+    return LANE_CONFIG;
+}
+
+// Append j to lane's queue. Caller holds workq.lock.
+static void lane_push_locked(lane_t lane, job_t *j) {
+    struct lane *l = &lanes[lane];
+    clock_gettime(CLOCK_MONOTONIC, &j->queued);
+    if (l->tail) l->tail->next = j; else l->head = j;
+    l->tail = j;
+    l->len++;
+    pthread_cond_signal(&l->cond);
+}
+
+// Queue a blocking command; returns -1 if its lane is full, with the lane
+// in *lane either way. drain_fd (or -1) is handed to the job, see
+// wait_output_acked().
+static int submit_job(conn_t *c, const char *tag, const char *cmd, int drain_fd, lane_t *lane) {
+    *lane = command_lane(cmd);
+    job_t *j = calloc(1, sizeof(*j));
+    if (!j) return -1;
+    j->conn = c;
+    j->drain_fd = drain_fd;
+    snprintf(j->tag, sizeof(j->tag), "%s", tag);
+    snprintf(j->cmd, sizeof(j->cmd), "%s", cmd);
+
+    pthread_mutex_lock(&workq.lock);
+    if (lanes[*lane].len >= lanes[*lane].queue_len) {
+        pthread_mutex_unlock(&workq.lock);
+        free(j);
+        return -1;
     }
-    buffer[n] = '\0';
-    if (verbose) printf("[DEBUG] Received: %s\n", buffer);
+    lane_push_locked(*lane, j);
+    pthread_mutex_unlock(&workq.lock);
+    return 0;
+}
+
+// Queue work that has no client, e.g. reverting an expired transaction.
+// Internal jobs are never refused.
+static int submit_internal_job(lane_t lane, const char *name, void (*run)(job_t *), int arg,
+                               const char *data) {
+    job_t *j = calloc(1, sizeof(*j));
+    if (!j) return -1;
+    j->drain_fd = -1;
+    j->name = name;
+    j->run = run;
+    j->arg = arg;
+    snprintf(j->cmd, sizeof(j->cmd), "%s", data);
+
+    pthread_mutex_lock(&workq.lock);
+    lane_push_locked(lane, j);
+    pthread_mutex_unlock(&workq.lock);
+    return 0;
+}
 
-    // 1) If it's a change_channel command, immediately ACK
-    if (strncmp(buffer, "change_channel", 14) == 0) {
-        const char *ack = 
-            "Channel change command received. "
-            "Attempting change and wait for confirmation.\n";
-        write(client_fd, ack, strlen(ack));
+static void txn_revert_job(job_t *j) {
+    txn_revert(j->arg, j->cmd);
+}
+
+// Timer fired: hand every expired transaction's revert to a worker.
+static void txn_expire(void) {
+    uint64_t cnt;
+    if (read(txn_tfd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN) perror("timerfd read");
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    pthread_mutex_lock(&txn_lock);
+    for (int k = 0; k < TXN_KINDS; k++) {
+        txn_t *t = &txns[k];
+        if (!t->active || t->deadline.tv_sec > now.tv_sec ||
+            (t->deadline.tv_sec == now.tv_sec && t->deadline.tv_nsec > now.tv_nsec))
+            continue;
+        t->active = 0;
+        stats_count(STAT_TXN_TIMEOUTS, 1);
+        if (verbose) printf("[DEBUG] %s change confirmation timed out\n", txn_ops[k].name);
+        if (submit_internal_job(LANE_CONFIG, "revert", txn_revert_job, k, t->old_value) != 0)
+            fprintf(stderr, "[WARN] could not queue %s revert\n", txn_ops[k].name);
+    }
+    txn_rearm_locked();
+    pthread_mutex_unlock(&txn_lock);
+}
+
+// Commands answered straight from memory or a small file; never block.
+static int command_is_inline(const char *cmd) {
+    return strncmp(cmd, "get_all_video_modes", 19) == 0 ||
+           strncmp(cmd, "get_current_video_mode", 22) == 0 ||
+           strcmp(cmd, "cache_stats") == 0 || strcmp(cmd, "pipeline_status") == 0;
+}
+
+static void telemetry_rearm(void);
+
+static void conn_close(conn_t *c) {
+    if (c->fd >= 0) {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+        close(c->fd);
+        c->fd = -1;
+    }
+    if (c->subscribe_ms) {
+        c->subscribe_ms = 0;
+        telemetry_rearm();
+    }
+    if (c->inflight) { c->dead = 1; return; }   // workers still hold it
+    for (int i = 0; i < MAX_CONNS; i++)
+        if (conns[i] == c) { conns[i] = NULL; break; }
+    stats_count(STAT_CONNS, -1);
+    c->next_closed = closed_conns;
+    closed_conns = c;
+}
+
+static void conn_update_events(conn_t *c) {
+    struct epoll_event ev = {
+        .events = (c->read_done ? 0 : EPOLLIN) | (c->out_len ? EPOLLOUT : 0),
+        .data.ptr = c
+    };
+    epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+// Flush as much pending output as the socket takes. Returns -1 if the
+// connection was closed.
+static int conn_flush(conn_t *c) {
+    while (c->out_off < c->out_len) {
+        ssize_t n = send(c->fd, c->out + c->out_off, c->out_len - c->out_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            conn_close(c);
+            return -1;
+        }
+        c->out_off += n;
+    }
+    if (c->out_off == c->out_len) {
+        c->out_off = c->out_len = 0;
+        if (c->closing && !c->inflight) { conn_close(c); return -1; }
+    }
+    conn_update_events(c);
+    return 0;
+}
+
+static void conn_queue_output(conn_t *c, const char *data, size_t len) {
+    if (c->out_len + len > c->out_cap) {
+        size_t cap = c->out_cap ? c->out_cap : BUF_SIZE;
+        while (cap < c->out_len + len) cap *= 2;
+        if (cap > CONN_OUT_MAX) cap = CONN_OUT_MAX;
+        char *p = realloc(c->out, cap);
+        if (!p) return;
+        c->out = p;
+        c->out_cap = cap;
+        if (len > cap - c->out_len) len = cap - c->out_len;
+    }
+    memcpy(c->out + c->out_len, data, len);
+    c->out_len += len;
+}
+
+// Send data right away if nothing is queued ahead of it; whatever the
+// socket doesn't take is queued. Errors surface on the next flush.
+static void conn_send_now(conn_t *c, const char *data, size_t len) {
+    if (!c->out_len) {
+        ssize_t n = send(c->fd, data, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0) { data += n; len -= n; }
+    }
+    if (len) conn_queue_output(c, data, len);
+}
+
+// Queue one reply. Outside a session the reply goes out as-is; inside a
+// session it is framed (see above).
+static void conn_reply(conn_t *c, const char *tag, const char *response) {
+    if (!c->session) {
+        conn_queue_output(c, response, strlen(response));
+        return;
+    }
+    if (tag[0]) {
+        conn_queue_output(c, "@", 1);
+        conn_queue_output(c, tag, strlen(tag));
+        conn_queue_output(c, "\n", 1);
+    }
+    const char *p = response;
+    while (*p) {
+        size_t len = strcspn(p, "\n");
+        if (*p == '.') conn_queue_output(c, ".", 1);
+        conn_queue_output(c, p, len);
+        conn_queue_output(c, "\n", 1);
+        p += len;
+        if (*p == '\n') p++;
+    }
+    conn_queue_output(c, ".\n", 2);
+}
+
+// ─── Telemetry subscriptions ───
+// "subscribe [interval_ms]" turns a connection into a telemetry stream: one
+// line of space-separated key=value pairs per interval, e.g.
+//     t=81234 ch=161 bw=20 mcs=2 fec=8/12 txpower=1 bitrate=8000 fps=60 alink=ok
+// On a one-shot connection the lines are written as-is until the client
+// closes the socket. Inside a session each line is framed as a reply tagged
+// "*", and "unsubscribe" stops the stream. One worker job samples the state
+// per tick of tele_tfd (the shortest interval among subscribers) and the
+// loop hands the line to every subscriber that is due. alink's status is
+// cached between ticks and, once alink fails to answer, retried with a
+// doubling backoff so a dead alink cannot stall the fast lane every tick.
+
+// Worker side: build one telemetry line into j->response.
+static void telemetry_sample_job(job_t *j) {
+    char fec_k[16] = "?", fec_n[16] = "?", bitrate[16] = "?", fps[16] = "?";
+    int k, n;
+    if (wfb_tx_get_fec(&k, &n) == 0) {
+        snprintf(fec_k, sizeof(fec_k), "%d", k);
+        snprintf(fec_n, sizeof(fec_n), "%d", n);
+    } else {
+        yaml_cache_get(&wfb_yaml, ".broadcast.fec_k", fec_k, sizeof(fec_k));
+        yaml_cache_get(&wfb_yaml, ".broadcast.fec_n", fec_n, sizeof(fec_n));
+    }
+    yaml_cache_get(&majestic_yaml, ".video0.bitrate", bitrate, sizeof(bitrate));
+    yaml_cache_get(&majestic_yaml, ".video0.fps", fps, sizeof(fps));
+
+    // Only one sample job runs at a time (tele_sampling), so no lock.
+    static char status[BUF_SIZE / 2];
+    static int st = -1, backoff_ms;
+    static long long next_ms;
+    long long now = monotonic_ms();
+    if (now >= next_ms) {
+        st = alink_get_status(status, sizeof(status));
+        for (char *p = status; *p; p++)
+            if (*p == '\n' || *p == '\r') *p = ' ';
+        if (st == 0)
+            backoff_ms = TELE_ALINK_REFRESH_MS;
+        else if (backoff_ms < TELE_ALINK_BACKOFF_MAX_MS)
+            backoff_ms = backoff_ms ? backoff_ms * 2 : TELE_ALINK_REFRESH_MS;
+        next_ms = monotonic_ms() + backoff_ms;
+    }
+
+    snprintf(j->response, sizeof(j->response),
+             "t=%lld ch=%d bw=%d mcs=%d fec=%s/%s txpower=%d bitrate=%s fps=%s alink=%s%s%s",
+             now, current_channel, current_bandwidth, current_mcs,
+             fec_k, fec_n, current_txpower, bitrate, fps,
+             st == 0 ? "ok" : st < 0 ? "down" : "error",
+             st == 0 && status[0] ? " " : "", st == 0 ? status : "");
+}
+
+static int conn_is_subscriber(const conn_t *c) {
+    return c && c->fd >= 0 && c->subscribe_ms && !c->closing;
+}
+
+// Tick at the shortest subscriber interval, or stop when nobody listens.
+static void telemetry_rearm(void) {
+    int min_ms = 0;
+    for (int i = 0; i < MAX_CONNS; i++)
+        if (conn_is_subscriber(conns[i]) && (!min_ms || conns[i]->subscribe_ms < min_ms))
+            min_ms = conns[i]->subscribe_ms;
+    struct itimerspec its = {0};
+    its.it_interval.tv_sec = min_ms / 1000;
+    its.it_interval.tv_nsec = (min_ms % 1000) * 1000000L;
+    its.it_value = its.it_interval;
+    if (tele_tfd >= 0) timerfd_settime(tele_tfd, 0, &its, NULL);
+}
+
+static void telemetry_kick(void) {
+    if (tele_sampling) return;
+    if (submit_internal_job(LANE_FAST, "telemetry", telemetry_sample_job, 0, "") == 0) tele_sampling = 1;
+}
+
+static void telemetry_tick(void) {
+    uint64_t cnt;
+    if (read(tele_tfd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN) perror("timerfd read");
+    telemetry_kick();
+}
+
+static void stats_dump_job(job_t *j) {
+    (void)j;
+    if (stats_dump_json(STATS_JSON_PATH) != 0)
+        fprintf(stderr, "[WARN] could not write %s: %s\n", STATS_JSON_PATH, strerror(errno));
+}
+
+// The dump touches the filesystem, so it runs on a worker like any write.
+static void stats_tick(void) {
+    uint64_t cnt;
+    if (read(stats_tfd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN) perror("timerfd read");
+    submit_internal_job(LANE_FAST, "stats_dump", stats_dump_job, 0, "");
+}
+
+// Loop side: a sample is ready; send it to every subscriber that is due.
+static void telemetry_publish(const char *line) {
+    tele_sampling = 0;
+    long long now = monotonic_ms();
+    for (int i = 0; i < MAX_CONNS; i++) {
+        conn_t *c = conns[i];
+        if (!conn_is_subscriber(c) || now < c->next_push - SUBSCRIBE_SLACK_MS) continue;
+        c->next_push += c->subscribe_ms;
+        if (c->next_push <= now) c->next_push = now + c->subscribe_ms;
+        if (c->out_len + strlen(line) + 8 > CONN_OUT_MAX) {
+            // The client stopped reading; don't let its backlog grow.
+            if (verbose) printf("[DEBUG] Dropping stalled subscriber\n");
+            conn_close(c);
+            continue;
+        }
+        if (c->session) {
+            conn_reply(c, "*", line);
+        } else {
+            conn_queue_output(c, line, strlen(line));
+            conn_queue_output(c, "\n", 1);
+        }
+        conn_flush(c);
+    }
+}
+
+// "subscribe [interval_ms]" / "unsubscribe".
+static void conn_subscribe(conn_t *c, const char *tag, const char *cmd) {
+    if (strcmp(cmd, "unsubscribe") == 0) {
+        c->subscribe_ms = 0;
+        telemetry_rearm();
+        conn_reply(c, tag, "unsubscribed");
+        return;
+    }
+    const char *arg = cmd + 9;
+    while (*arg == ' ') arg++;
+    char *end;
+    long ms = *arg ? strtol(arg, &end, 10) : SUBSCRIBE_DEFAULT_MS;
+    if (*arg && (*end || ms <= 0)) {
+        conn_reply(c, tag, "Invalid usage. Format: subscribe [interval_ms]");
+        return;
+    }
+    if (ms < SUBSCRIBE_MIN_MS) ms = SUBSCRIBE_MIN_MS;
+    if (ms > SUBSCRIBE_MAX_MS) ms = SUBSCRIBE_MAX_MS;
+
+    c->closing = 0;          // a one-shot subscriber stays open
+    c->subscribe_ms = ms;
+    c->next_push = monotonic_ms();
+    if (c->session) {
+        char reply[64];
+        snprintf(reply, sizeof(reply), "subscribed %ld ms", ms);
+        conn_reply(c, tag, reply);
+    }
+    telemetry_rearm();
+    telemetry_kick();        // first line right away
+}
+
+// Run one command line from c, inline or on a worker.
+// Queue a reply and account the time it took as cmd's write stage.
+static void conn_reply_timed(conn_t *c, const char *tag, const char *cmd, const char *response) {
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    conn_reply(c, tag, response);
+    stats_record(cmd, STAT_WRITE, elapsed_us(&t0));
+}
+
+// t_in: when the line was taken off the input buffer.
+static void conn_run(conn_t *c, const char *tag, const char *cmd, const struct timespec *t_in) {
+    stats_record(cmd, STAT_PARSE, elapsed_us(t_in));
+    if (verbose) printf("[DEBUG] Received: %s%s%s\n", tag, tag[0] ? " " : "", cmd);
+
+    // 1) On one-shot connections, changes that can cut the link ACK before
+    //    they are attempted, and the worker waits for the ACK to be
+    //    delivered before hopping. Sessions get the normal framed reply.
+    const char *ack = NULL;
+    if (!c->session && strncmp(cmd, "change_channel", 14) == 0)
+        ack = "Channel change command received. "
+              "Attempting change and wait for confirmation.\n";
+    else if (!c->session && strncmp(cmd, "change_bandwidth", 16) == 0)
+        ack = "Bandwidth change command received. "
+              "Attempting change and wait for confirmation.\n";
+    if ((strncmp(cmd, "subscribe", 9) == 0 && (cmd[9] == '\0' || cmd[9] == ' ')) ||
+        strcmp(cmd, "unsubscribe") == 0) {
+        conn_subscribe(c, tag, cmd);
+        return;
+    }
+
+    int drain_fd = -1;
+    if (ack) {
+        conn_send_now(c, ack, strlen(ack));
+        drain_fd = dup(c->fd);
     }
 
-    // 2) Now do the full processing (this will block/sleep, etc.)
     char response[BUF_SIZE] = {0};
-    process_command(buffer, response, sizeof(response));
-    if (verbose) printf("[DEBUG] Responding: %s\n", response);
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (strncmp(cmd, "get_all_video_modes", 19) == 0) {
+        const char *modes = video_modes_response();    // may exceed BUF_SIZE
+        stats_record(cmd, STAT_EXEC, elapsed_us(&t0));
+        conn_reply_timed(c, tag, cmd, modes);
+    } else if (strcmp(cmd, "stats") == 0 || strncmp(cmd, "stats ", 6) == 0) {
+        // Every command and stage is a line; can exceed BUF_SIZE too.
+        static char out[STATS_REPLY_MAX];
+        const char *arg = cmd[5] ? cmd + 6 : NULL;
+        if (arg && strcmp(arg, "reset") == 0) {
+            stats_reset();
+            snprintf(out, sizeof(out), "Stats reset.");
+        } else {
+            stats_format(out, sizeof(out), arg);
+        }
+        conn_reply(c, tag, out);
+    } else if (native_query(cmd, response, sizeof(response)) == 0) {
+        stats_record(cmd, STAT_EXEC, elapsed_us(&t0));
+        if (verbose) printf("[DEBUG] Responding (native): %s\n", response);
+        conn_reply_timed(c, tag, cmd, response);
+    } else if (command_is_inline(cmd)) {
+        process_command(cmd, response, sizeof(response));
+        stats_record(cmd, STAT_EXEC, elapsed_us(&t0));
+        if (verbose) printf("[DEBUG] Responding: %s\n", response);
+        conn_reply_timed(c, tag, cmd, response);
+    } else {
+        lane_t lane;
+        if (submit_job(c, tag, cmd, drain_fd, &lane) == 0) {
+            c->inflight++;
+            if (!tag[0]) c->ordered_busy = 1;
+            drain_fd = -1;
+        } else {
+            char busy[96];
+            snprintf(busy, sizeof(busy), "Error: air_man busy (%s queue full), try again.",
+                     lanes[lane].name);
+            stats_count(STAT_BUSY, 1);
+            conn_reply(c, tag, busy);
+        }
+    }
+    if (drain_fd >= 0) close(drain_fd);
+}
+
+// Consume complete lines from a session's input buffer. Untagged commands
+// wait for the previous untagged one; tagged ones are capped per session.
+static void session_process_lines(conn_t *c) {
+    while (!c->closing) {
+        struct timespec t_in;
+        clock_gettime(CLOCK_MONOTONIC, &t_in);
+        char *nl = memchr(c->in, '\n', c->in_len);
+        if (!nl && !c->read_done) break;          // wait for the rest
+        size_t line_len = nl ? (size_t)(nl - c->in) : c->in_len;
+        if (!nl && !line_len) break;
+
+        char line[BUF_SIZE];
+        memcpy(line, c->in, line_len);
+        line[line_len] = '\0';
+        line[strcspn(line, "\r")] = '\0';
+
+        char tag[SESSION_TAG_LEN] = "";
+        char *cmd = line;
+        if (line[0] == '@') {
+            size_t tl = strcspn(line + 1, " \t");
+            if (tl >= sizeof(tag)) tl = sizeof(tag) - 1;
+            memcpy(tag, line + 1, tl);
+            tag[tl] = '\0';
+            cmd = line + 1 + strcspn(line + 1, " \t");
+            while (*cmd == ' ' || *cmd == '\t') cmd++;
+        }
+        if (!tag[0] && c->ordered_busy) break;
+        if (tag[0] && c->inflight >= SESSION_MAX_INFLIGHT) break;
 
-    // 3) Send the final result
-    write(client_fd, response, strlen(response));
+        size_t consumed = nl ? line_len + 1 : line_len;
+        memmove(c->in, c->in + consumed, c->in_len - consumed);
+        c->in_len -= consumed;
 
-    close(client_fd);
-    pthread_exit(NULL);
+        if (!cmd[0]) continue;
+        if (strcmp(cmd, "quit") == 0 || strcmp(cmd, "exit") == 0) {
+            c->closing = 1;
+            break;
+        }
+        conn_run(c, tag, cmd, &t_in);
+    }
+    if (c->read_done && !c->in_len) c->closing = 1;
+    conn_flush(c);
+}
+
+// The first line of a connection decides between one-shot and session mode.
+static void conn_dispatch_first(conn_t *c) {
+    struct timespec t_in;
+    clock_gettime(CLOCK_MONOTONIC, &t_in);
+    c->in[c->in_len] = '\0';
+    size_t line_len = strcspn(c->in, "\r\n");
+
+    if (line_len == 7 && strncmp(c->in, "session", 7) == 0) {
+        size_t consumed = line_len + strspn(c->in + line_len, "\r\n");
+        memmove(c->in, c->in + consumed, c->in_len - consumed);
+        c->in_len -= consumed;
+        c->session = 1;
+        if (verbose) printf("[DEBUG] Session started\n");
+        conn_reply(c, "", "session started");
+        session_process_lines(c);
+        return;
+    }
+
+    c->in[line_len] = '\0';
+    c->closing = 1;
+    conn_run(c, "", c->in, &t_in);
+    c->in_len = 0;
+    conn_flush(c);
+}
+
+static void conn_readable(conn_t *c) {
+    for (;;) {
+        if (c->closing || (!c->session && c->subscribe_ms)) {
+            // One-shot connection already has its command; discard the rest.
+            char sink[256];
+            ssize_t n = recv(c->fd, sink, sizeof(sink), 0);
+            if (n > 0) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+            if (n < 0 || (!c->inflight && !c->out_len && !c->subscribe_ms)) { conn_close(c); return; }
+            // Half-closed: stop reading but keep the socket for the reply.
+            c->read_done = 1;
+            conn_update_events(c);
+            return;
+        }
+        if (c->in_len >= sizeof(c->in) - 1) {
+            if (!c->session) { conn_dispatch_first(c); return; }
+            // Session line longer than BUF_SIZE or blocked behind a busy
+            // command: stop reading until the buffer drains.
+            session_process_lines(c);
+            if (c->fd >= 0 && c->in_len >= sizeof(c->in) - 1) {
+                if (!memchr(c->in, '\n', c->in_len)) {
+                    conn_reply(c, "", "Error: command too long.");
+                    c->closing = 1;
+                    conn_flush(c);
+                }
+            }
+            return;
+        }
+        ssize_t n = recv(c->fd, c->in + c->in_len, sizeof(c->in) - 1 - c->in_len, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) conn_close(c);
+            return;
+        }
+        if (n == 0) {
+            // Peer finished sending; run whatever it gave us.
+            c->read_done = 1;
+            if (c->session) session_process_lines(c);
+            else if (c->in_len) conn_dispatch_first(c);
+            else conn_close(c);
+            return;
+        }
+        c->in_len += n;
+        c->last_active = time(NULL);
+        if (c->session) {
+            session_process_lines(c);
+            if (c->fd < 0 || c->closing) return;
+        } else if (memchr(c->in, '\n', c->in_len)) {
+            conn_dispatch_first(c);
+            return;
+        }
+    }
+}
+
+// Drain the completion list posted by workers.
+static void collect_done_jobs(void) {
+    uint64_t cnt;
+    if (read(done_efd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN) perror("eventfd read");
+
+    pthread_mutex_lock(&workq.lock);
+    job_t *j = workq.done;
+    workq.done = NULL;
+    pthread_mutex_unlock(&workq.lock);
+
+    while (j) {
+        job_t *next = j->next;
+        conn_t *c = j->conn;
+        if (!c) {           // internal job, nobody to answer
+            if (j->run == telemetry_sample_job) telemetry_publish(j->response);
+            free(j);
+            j = next;
+            continue;
+        }
+        c->inflight--;
+        if (!j->tag[0]) c->ordered_busy = 0;
+        if (c->dead) {
+            if (!c->inflight) conn_close(c);
+        } else {
+            if (verbose) printf("[DEBUG] Responding: %s\n", j->response);
+            c->last_active = time(NULL);
+            struct timespec t0;
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            conn_reply(c, j->tag, j->response);
+            if (c->session) {
+                stats_record(j->cmd, STAT_WRITE, elapsed_us(&t0));
+                session_process_lines(c);
+            } else {
+                conn_flush(c);      // may free c
+                stats_record(j->cmd, STAT_WRITE, elapsed_us(&t0));
+            }
+        }
+        free(j);
+        j = next;
+    }
+}
+
+static void accept_clients(int server_fd) {
+    for (;;) {
+        struct sockaddr_in caddr; socklen_t len = sizeof(caddr);
+        int fd = accept4(server_fd, (struct sockaddr*)&caddr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) perror("accept");
+            return;
+        }
+        if (verbose) {
+            char ip[INET_ADDRSTRLEN]; inet_ntop(AF_INET,&caddr.sin_addr,ip,sizeof(ip));
+            fprintf(stderr,"[DEBUG] Conn from %s:%d\n",ip,ntohs(caddr.sin_port));
+        }
+        int slot = -1;
+        for (int i = 0; i < MAX_CONNS; i++) if (!conns[i]) { slot = i; break; }
+        conn_t *c = slot >= 0 ? calloc(1, sizeof(*c)) : NULL;
+        if (!c) {
+            const char *busy = "Error: air_man busy, try again.";
+            send(fd, busy, strlen(busy), MSG_NOSIGNAL);
+            stats_count(STAT_BUSY, 1);
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->last_active = time(NULL);
+        conns[slot] = c;
+        stats_count(STAT_CONNS, 1);
+        stats_count(STAT_CONNS_TOTAL, 1);
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) { perror("epoll_ctl"); conn_close(c); }
+    }
+}
+
+// Drop connections that went quiet without a command in flight.
+static void reap_idle_conns(void) {
+    time_t now = time(NULL);
+    for (int i = 0; i < MAX_CONNS; i++) {
+        conn_t *c = conns[i];
+        if (!c || c->fd < 0 || c->inflight || (c->closing && c->out_len) ||
+            conn_is_subscriber(c))
+            continue;
+        int limit = c->session ? SESSION_IDLE_TIMEOUT : CONN_IDLE_TIMEOUT;
+        if (difftime(now, c->last_active) >= limit) {
+            if (verbose) printf("[DEBUG] Closing idle connection\n");
+            stats_count(STAT_CONN_TIMEOUTS, 1);
+            conn_close(c);
+        }
+    }
+}
+
+static void run_event_loop(int server_fd) {
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    done_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epfd < 0 || done_efd < 0) { perror("epoll/eventfd"); exit(EXIT_FAILURE); }
+
+    static int listen_tag, done_tag, timer_tag, tele_tag, stats_tag;
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &listen_tag };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, server_fd, &ev);
+    ev.data.ptr = &done_tag;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, done_efd, &ev);
+    ev.data.ptr = &timer_tag;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, txn_tfd, &ev);
+    tele_tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (tele_tfd < 0) { perror("timerfd_create"); exit(EXIT_FAILURE); }
+    ev.data.ptr = &tele_tag;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, tele_tfd, &ev);
+    if (stats_dump_s > 0) {
+        stats_tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (stats_tfd < 0) { perror("timerfd_create"); exit(EXIT_FAILURE); }
+        struct itimerspec its = { { stats_dump_s, 0 }, { stats_dump_s, 0 } };
+        timerfd_settime(stats_tfd, 0, &its, NULL);
+        ev.data.ptr = &stats_tag;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, stats_tfd, &ev);
+    }
+
+    for (int l = 0; l < LANES; l++) {
+        for (int i = 0; i < lanes[l].threads; i++) {
+            pthread_t t;
+            if (pthread_create(&t, NULL, worker_main, &lanes[l]) != 0) { perror("pthread_create"); exit(EXIT_FAILURE); }
+            pthread_detach(t);
+        }
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    while (1) {
+        int n = epoll_wait(epfd, events, MAX_EVENTS, 1000);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            void *tag = events[i].data.ptr;
+            if (tag == &listen_tag) {
+                accept_clients(server_fd);
+            } else if (tag == &done_tag) {
+                collect_done_jobs();
+            } else if (tag == &timer_tag) {
+                txn_expire();
+            } else if (tag == &tele_tag) {
+                telemetry_tick();
+            } else if (tag == &stats_tag) {
+                stats_tick();
+            } else {
+                conn_t *c = tag;
+                if (c->fd < 0) continue;
+                if (events[i].events & (EPOLLERR | EPOLLHUP) && !(events[i].events & EPOLLIN)) {
+                    conn_close(c);
+                    continue;
+                }
+                if (events[i].events & EPOLLOUT) {
+                    if (conn_flush(c) < 0) continue;
+                }
+                if (events[i].events & EPOLLIN) conn_readable(c);
+            }
+        }
+        reap_idle_conns();
+        while (closed_conns) {
+            conn_t *c = closed_conns;
+            closed_conns = c->next_closed;
+            free(c->out);
+            free(c);
+        }
+    }
 }
 
 int main(int argc,char *argv[]) {
     int opt;
-    while ((opt=getopt(argc,argv,"vs:-:"))!=-1) {
+    stats_init();
+    while ((opt=getopt(argc,argv,"vs:w:j:-:"))!=-1) {
         if (opt=='v') verbose=1;
         else if (opt=='s') script=optarg;
+        else if (opt=='w') wfb_tx_set_port(atoi(optarg));
+        else if (opt=='j') stats_dump_s=atoi(optarg);
         else if (opt=='-'&&strcmp(optarg,"verbose")==0) verbose=1;
         else if (opt=='-'&&strncmp(optarg,"script=",7)==0) script=optarg+7;
+        else if (opt=='-'&&strncmp(optarg,"wfb-port=",9)==0) wfb_tx_set_port(atoi(optarg+9));
+        else if (opt=='-'&&strncmp(optarg,"stats-json=",11)==0) stats_dump_s=atoi(optarg+11);
     }
     if (verbose) fprintf(stderr,"[DEBUG] Starting server in verbose mode.\n");
 	
 	char detected_sensor[32] = {0};
 
-	FILE *fp = popen("ipcinfo -s", "r");
+	stats_count(STAT_POPENS, 1);
+	FILE *fp = child_popen("ipcinfo -s");
 	if (fp && fgets(detected_sensor, sizeof(detected_sensor), fp)) {
 		detected_sensor[strcspn(detected_sensor, "\r\n")] = 0; // strip newline
 		if (verbose) printf("[INFO] Detected sensor: %s\n", detected_sensor);
 	}
-	if (fp) pclose(fp);
+	if (fp) child_pclose(fp);
 
 	const char *video_mode_file = NULL;
 	if (strcmp(detected_sensor, "imx335") == 0) {
-		video_mode_file = "/etc/sensors/modes_imx335.ini";
+		video_mode_file = AIR_MAN_SYSROOT "/etc/sensors/modes_imx335.ini";
 	} else if (strcmp(detected_sensor, "imx415") == 0) {
-		video_mode_file = "/etc/sensors/modes_imx415.ini";
+		video_mode_file = AIR_MAN_SYSROOT "/etc/sensors/modes_imx415.ini";
 	} else {
 		fprintf(stderr, "Unknown sensor: %s\n", detected_sensor);
 	}
 
 	load_video_modes(video_mode_file);
+	load_applied_crop();
+	// The crop is lost with every majestic start; put it back once the
+	// pipeline is up, as the old rc.local block did.
+	if (strcmp(applied_crop, "nocrop") != 0) start_pipeline_thread(1, applied_crop);
 	
-    char *val = read_yaml_value("/etc/wfb.yaml",".wireless.channel");
+    char *val = read_yaml_value(WFB_YAML,".wireless.channel");
     current_channel = val?atoi(val):165; if(val)free(val);
-	char *val2 = read_yaml_value("/etc/wfb.yaml",".wireless.width");
-	current_bandwidth = atoi(val2);
+	char *val2 = read_yaml_value(WFB_YAML,".wireless.width");
+	current_bandwidth = val2?atoi(val2):20; if(val2)free(val2);
 	
-    init_pending_changes();
-    pthread_t tid; pthread_create(&tid,NULL,confirmation_checker,NULL); pthread_detach(tid);
+	char *val3 = read_yaml_value(WFB_YAML,".broadcast.mcs_index");
+	current_mcs = val3?atoi(val3):0; if(val3)free(val3);
+	char *val4 = read_yaml_value(WFB_YAML,".wireless.txpower");
+	current_txpower = val4?atoi(val4):1; if(val4)free(val4);
+	if (link_catalog_load(&link_catalog, LINK_MODES_YAML, WLAN_ADAPTERS_YAML, WFB_YAML) != 0)
+		fprintf(stderr, "[WARN] Link modes not loaded for adapter '%s'\n", link_catalog.adapter);
+	char txp_err[256];
+	if (txprofiles_load(&txprofiles, TXPROFILES_CONF, txp_err, sizeof(txp_err)) != 0)
+		fprintf(stderr, "[WARN] %s\n", txp_err);
+	FILE *mf = fopen(MODE_CURRENT_FILE, "r");
+	if (mf) {
+		if (fgets(current_video_mode, sizeof(current_video_mode), mf))
+			current_video_mode[strcspn(current_video_mode, "\r\n")] = 0;
+		fclose(mf);
+	}
+
+    txn_tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (txn_tfd < 0) { perror("timerfd_create"); exit(EXIT_FAILURE); }
 
-    int server_fd = socket(AF_INET,SOCK_STREAM,0);
+    int server_fd = socket(AF_INET,SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC,0);
     if (server_fd<0) { perror("socket failed"); exit(EXIT_FAILURE); }
     int optv=1;
     setsockopt(server_fd,SOL_SOCKET,SO_REUSEADDR,&optv,sizeof(optv));
@@ -693,15 +2786,6 @@ int main(int argc,char *argv[]) {
     if (listen(server_fd,10)<0) { perror("listen failed"); close(server_fd); exit(EXIT_FAILURE); }
     printf("alink_manager server running on port %d\n",PORT);
 
-    while (1) {
-        struct sockaddr_in caddr; socklen_t len=sizeof(caddr);
-        int *cfd = malloc(sizeof(int)); if(!cfd){perror("malloc"); continue;}
-        if ((*cfd=accept(server_fd,(struct sockaddr*)&caddr,&len))<0) { perror("accept"); free(cfd); continue; }
-        if (verbose) {
-            char ip[INET_ADDRSTRLEN]; inet_ntop(AF_INET,&caddr.sin_addr,ip,sizeof(ip));
-            fprintf(stderr,"[DEBUG] Conn from %s:%d\n",ip,ntohs(caddr.sin_port));
-        }
-        pthread_t t; pthread_create(&t,NULL,client_handler,cfd); pthread_detach(t);
-    }
+    run_event_loop(server_fd);
     close(server_fd); return 0;
 }
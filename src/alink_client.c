@@ -0,0 +1,174 @@
+/*
+ * alink_client.c - persistent connection to /tmp/alink_cmd.sock
+ *
+ * One AF_UNIX stream connection is kept open and reused; if alink closed
+ * it (or was restarted) the request is retried once on a fresh connection.
+ * Callers from different threads are served strictly in arrival order
+ * through a ticket queue, one request on the wire at a time, and each
+ * request goes out as one vectored write of header + payload (sendmsg with
+ * MSG_NOSIGNAL, so a dead peer is EPIPE rather than SIGPIPE).
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "alink_client.h"
+
+#define ALINK_MAX_ARGS 4
+#define ALINK_MAX_REPLY 512
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t turn;
+    unsigned long next_ticket;   // handed to each caller
+    unsigned long serving;       // ticket allowed on the wire
+    int fd;
+} ac = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, -1 };
+
+static int alink_connect(void) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    struct timeval tv = { ALINK_TIMEOUT_MS / 1000, (ALINK_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, ALINK_CMD_SOCKET_PATH, sizeof(addr.sun_path) - 1);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Read exactly len bytes. Returns len, 0 on EOF before any byte, -1 otherwise.
+static ssize_t read_full(int fd, void *buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = read(fd, (char *)buf + got, len - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return (n == 0 && got == 0) ? 0 : -1;
+        got += n;
+    }
+    return got;
+}
+
+static ssize_t writev_full(int fd, struct iovec *iov, int iovcnt) {
+    ssize_t total = 0;
+    while (iovcnt > 0) {
+        struct msghdr msg = { .msg_iov = iov, .msg_iovlen = iovcnt };
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        total += n;
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return total;
+}
+
+// One round trip on ac.fd. Returns the status, -1 on a protocol error, or
+// -2 if the connection turned out to be dead before alink answered.
+static int round_trip(uint16_t cmd, const int32_t *args, int n, char *text, size_t text_size) {
+    int32_t payload[ALINK_MAX_ARGS];
+    for (int i = 0; i < n; i++) payload[i] = htonl(args[i]);
+    struct alink_msg_hdr hdr = { htons(cmd), htons(n * sizeof(int32_t)) };
+    struct iovec iov[2] = {
+        { &hdr, sizeof(hdr) },
+        { payload, n * sizeof(int32_t) }
+    };
+    if (writev_full(ac.fd, iov, n ? 2 : 1) < 0)
+        return (errno == EPIPE || errno == ECONNRESET) ? -2 : -1;
+
+    ssize_t r = read_full(ac.fd, &hdr, sizeof(hdr));
+    if (r == 0 || (r < 0 && errno == ECONNRESET)) return -2;
+    if (r < 0) return -1;
+    hdr.cmd = ntohs(hdr.cmd);
+    hdr.len = ntohs(hdr.len);
+    if (hdr.cmd != (cmd | CMD_STATUS_REPLY) || hdr.len < 4 || hdr.len > ALINK_MAX_REPLY)
+        return -1;
+
+    char reply[ALINK_MAX_REPLY];
+    if (read_full(ac.fd, reply, hdr.len) != hdr.len) return -1;
+    int32_t status;
+    memcpy(&status, reply, 4);
+    if (text && text_size)
+        snprintf(text, text_size, "%.*s", (int)(hdr.len - 4), reply + 4);
+    return ntohl(status);
+}
+
+int alink_request(uint16_t cmd, const int32_t *args, int n, char *text, size_t text_size) {
+    if (n < 0 || n > ALINK_MAX_ARGS) return -1;
+    if (text && text_size) text[0] = '\0';
+
+    pthread_mutex_lock(&ac.lock);
+    unsigned long ticket = ac.next_ticket++;
+    while (ac.serving != ticket) pthread_cond_wait(&ac.turn, &ac.lock);
+    pthread_mutex_unlock(&ac.lock);
+
+    // Only the ticket holder touches ac.fd from here on.
+    int rc = -1;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        int fresh = 0;
+        if (ac.fd < 0) {
+            ac.fd = alink_connect();
+            if (ac.fd < 0) break;
+            fresh = 1;
+        }
+        rc = round_trip(cmd, args, n, text, text_size);
+        if (rc >= 0 || rc == -1) {
+            if (rc == -1) { close(ac.fd); ac.fd = -1; }  // out of sync, start over
+            break;
+        }
+        close(ac.fd);          // stale connection: retry once on a new one
+        ac.fd = -1;
+        rc = -1;
+        if (fresh) break;
+    }
+
+    pthread_mutex_lock(&ac.lock);
+    ac.serving++;
+    pthread_cond_broadcast(&ac.turn);
+    pthread_mutex_unlock(&ac.lock);
+    return rc;
+}
+
+int alink_set_power(int level) {
+    int32_t a = level;
+    return alink_request(CMD_SET_POWER, &a, 1, NULL, 0);
+}
+
+int alink_get_status(char *text, size_t text_size) {
+    return alink_request(CMD_GET_STATUS, NULL, 0, text, text_size);
+}
+
+void alink_disconnect(void) {
+    pthread_mutex_lock(&ac.lock);
+    unsigned long ticket = ac.next_ticket++;
+    while (ac.serving != ticket) pthread_cond_wait(&ac.turn, &ac.lock);
+    if (ac.fd >= 0) close(ac.fd);
+    ac.fd = -1;
+    ac.serving++;
+    pthread_cond_broadcast(&ac.turn);
+    pthread_mutex_unlock(&ac.lock);
+}
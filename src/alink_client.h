@@ -0,0 +1,41 @@
+/*
+ * alink_client.h - client for alink_drone's command socket
+ *
+ * Wire format (all fields in network byte order):
+ *   request: struct alink_msg_hdr { cmd, len } + len bytes of payload
+ *   reply:   { cmd | CMD_STATUS_REPLY, len } + int32 status [+ text]
+ * Status 0 is OK, 1 is "value out of range"; CMD_GET_STATUS replies carry
+ * "key=value" lines after the status.
+ */
+#ifndef ALINK_CLIENT_H
+#define ALINK_CLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum {
+    CMD_SET_POWER      = 1,     // int32 power level
+    CMD_GET_STATUS     = 2,     // no payload
+    CMD_STATUS_REPLY   = 0x8000 // OR'd into cmd for replies
+};
+
+struct __attribute__((packed)) alink_msg_hdr {
+    uint16_t cmd;   // one of CMD_*
+    uint16_t len;   // length of payload in bytes
+};
+
+#define ALINK_CMD_SOCKET_PATH "/tmp/alink_cmd.sock"
+#define ALINK_TIMEOUT_MS 1000
+
+// Send cmd with n int32 arguments and wait for the reply. Text after the
+// status, if any, is copied to text. Returns the status alink sent back,
+// or -1 if alink could not be reached or answered with something else.
+int alink_request(uint16_t cmd, const int32_t *args, int n, char *text, size_t text_size);
+
+int alink_set_power(int level);
+int alink_get_status(char *text, size_t text_size);
+
+// Drop the connection (the next request reconnects).
+void alink_disconnect(void);
+
+#endif /* ALINK_CLIENT_H */
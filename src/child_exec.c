@@ -0,0 +1,19 @@
+/*
+ * child_exec.c - run shell commands with fork/exec (see child_exec.h)
+ */
+
+#include <stdlib.h>
+
+#include "child_exec.h"
+
+int child_system(const char *cmd) {
+    return system(cmd);
+}
+
+FILE *child_popen(const char *cmd) {
+    return popen(cmd, "r");
+}
+
+int child_pclose(FILE *f) {
+    return pclose(f);
+}
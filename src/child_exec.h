@@ -0,0 +1,20 @@
+/*
+ * child_exec.h - how air_man runs shell commands
+ *
+ * Every command line air_man hands to the shell (iw, cli, tx_manager.sh,
+ * killall, wifibroadcast, the fallback script, ...) goes through these
+ * three calls. child_exec.c forks the real thing. bench/stub_exec.c is a
+ * drop-in replacement for PC benchmarks; link it instead of child_exec.c.
+ */
+#ifndef CHILD_EXEC_H
+#define CHILD_EXEC_H
+
+#include <stdio.h>
+
+// As system(3): the wait status, or -1.
+int child_system(const char *cmd);
+// As popen(cmd, "r") / pclose(3).
+FILE *child_popen(const char *cmd);
+int child_pclose(FILE *f);
+
+#endif /* CHILD_EXEC_H */
@@ -0,0 +1,99 @@
+/*
+ * link-modes - command-line front end for link_modes.c
+ *
+ * Compile with:
+ *     gcc -o link-modes link-modes-cli.c link_modes.c stupid-yaml.c
+ *
+ * Usage:
+ *    link-modes [-m <link_modes.yaml>] [-a <wlan_adapters.yaml>] [-w <wfb.yaml>] <command>
+ *
+ * Commands (same output as datalink_manager.sh):
+ *    list               Modes per channel width for the active adapter
+ *                       (datalink_manager.sh --list-modes)
+ *    info               Adapter capabilities and live wfb settings (--info)
+ *    get-auto <kbps>    First mode at the current width that carries kbps
+ *                       with FEC 8/12 (--get-auto)
+ *    solve <kbps> [mhz] Most robust mode + FEC k/n + mlink that carries
+ *                       kbps, at the current width unless mhz is given
+ *
+ * air_man answers the same queries in-process ("link_modes ..."), from a
+ * catalog it loads once and reloads only when one of the files changes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "stupid-yaml.h"
+#include "link_modes.h"
+
+static void usage(const char *progname) {
+    fprintf(stderr, "Usage: %s [-m <link_modes.yaml>] [-a <wlan_adapters.yaml>] [-w <wfb.yaml>] "
+                    "list | info | get-auto <kbps> | solve <kbps> [mhz]\n", progname);
+}
+
+// .wireless.width from wfb.yaml, 20 if unset.
+static int current_width(const link_catalog_t *cat) {
+    YAMLNode *wfb = yaml_load(cat->files[2]);
+    char width[16] = "20";
+    if (wfb) yaml_get_value(wfb, ".wireless.width", width, sizeof(width));
+    free_node(wfb);
+    return atoi(width);
+}
+
+int main(int argc, char *argv[]) {
+    const char *modes_file = NULL, *adapters_file = NULL, *wfb_file = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "m:a:w:h")) != -1) {
+        switch (opt) {
+            case 'm': modes_file = optarg; break;
+            case 'a': adapters_file = optarg; break;
+            case 'w': wfb_file = optarg; break;
+            default: usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    static link_catalog_t cat;
+    if (link_catalog_load(&cat, modes_file, adapters_file, wfb_file) != 0) {
+        fprintf(stderr, "Error: could not load link modes for adapter '%s'.\n", cat.adapter);
+        return EXIT_FAILURE;
+    }
+
+    char out[8192];
+    int rc;
+    const char *cmd = argv[optind];
+    if (strcmp(cmd, "list") == 0) {
+        rc = link_catalog_list(&cat, out, sizeof(out));
+    } else if (strcmp(cmd, "info") == 0) {
+        rc = link_catalog_info(&cat, out, sizeof(out));
+    } else if (strcmp(cmd, "get-auto") == 0 && optind + 1 < argc) {
+        // "No mode fits ..." is still an answer; the script's get_auto
+        // printed it and returned 0 too, and --get-auto execs this.
+        link_catalog_get_auto(&cat, current_width(&cat), atoi(argv[optind + 1]), out, sizeof(out));
+        puts(out);
+        return EXIT_SUCCESS;
+    } else if (strcmp(cmd, "solve") == 0 && optind + 1 < argc) {
+        int kbps = atoi(argv[optind + 1]);
+        int width = optind + 2 < argc ? atoi(argv[optind + 2]) : current_width(&cat);
+        link_choice_t choice;
+        if (link_catalog_solve(&cat, width, kbps, &choice) != 0) {
+            printf("No mode fits %d kbps at %d MHz\n", kbps, width);
+            return EXIT_FAILURE;
+        }
+        rc = link_choice_format(&cat, &choice, out, sizeof(out));
+    } else {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (rc != 0) {
+        fprintf(stderr, "Error: output truncated.\n");
+        return EXIT_FAILURE;
+    }
+    puts(out);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,323 @@
+/*
+ * link_modes.c - link mode catalog (see link_modes.h)
+ *
+ * The YAML files are parsed with stupid-yaml into a throwaway tree and
+ * copied into fixed-size tables; nothing keeps a reference to the tree.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stupid-yaml.h"
+#include "link_modes.h"
+
+#define LM_FEC_K 8      // FEC assumed by get-auto, as in datalink_manager.sh
+#define LM_FEC_N 12
+
+static const char *node_str(YAMLNode *root, const char *path) {
+    YAMLNode *n = find_node(root, path);
+    return n && n->type == YAML_NODE_SCALAR && n->value ? n->value : NULL;
+}
+
+static int node_int(YAMLNode *root, const char *path, int def) {
+    const char *v = node_str(root, path);
+    return v ? atoi(v) : def;
+}
+
+// Join the items of a sequence with commas.
+static void join_seq(YAMLNode *seq, char *buf, size_t size) {
+    size_t off = 0;
+    buf[0] = '\0';
+    for (size_t i = 0; seq && seq->type == YAML_NODE_SEQUENCE && i < seq->num_children; i++) {
+        const char *v = seq->children[i]->value;
+        if (!v) continue;
+        int n = snprintf(buf + off, size - off, "%s%s", off ? "," : "", v);
+        if (n < 0 || (size_t)n >= size - off) break;
+        off += n;
+    }
+}
+
+static void load_mode(link_catalog_t *cat, YAMLNode *m) {
+    link_mode_t *lm = &cat->modes[cat->n_modes];
+    memset(lm, 0, sizeof(*lm));
+    snprintf(lm->name, sizeof(lm->name), "%s", m->key);
+    lm->mcs = node_int(m, "mcs", 0);
+    lm->bandwidth_mhz = node_int(m, "bandwidth_mhz", 20);
+    const char *gi = node_str(m, "guard_interval");
+    lm->short_gi = gi && strcmp(gi, "short") == 0;
+    const char *raw = node_str(m, "raw_rate_mbps");
+    lm->raw_rate_mbps = raw ? atof(raw) : 0;
+    lm->mlink = node_int(m, "mlink", 0);
+
+    YAMLNode *net = find_node(m, "net_rate_mbps");
+    for (int i = 0; i < cat->n_overheads; i++) {
+        char key[16];
+        snprintf(key, sizeof(key), "%d", cat->overheads[i]);
+        const char *v = net ? node_str(net, key) : NULL;
+        lm->net_rate_mbps[i] = v ? atof(v) : 0;
+    }
+    cat->n_modes++;
+}
+
+static int cmp_int(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+static void load_overheads(link_catalog_t *cat, YAMLNode *root) {
+    YAMLNode *p = find_node(root, ".link_modes.overhead_presets");
+    cat->n_overheads = 0;
+    for (size_t i = 0; p && i < p->num_children && cat->n_overheads < LM_MAX_OVERHEADS; i++)
+        if (p->children[i]->value)
+            cat->overheads[cat->n_overheads++] = atoi(p->children[i]->value);
+    qsort(cat->overheads, cat->n_overheads, sizeof(int), cmp_int);
+}
+
+static void load_adapter(link_catalog_t *cat, YAMLNode *profile) {
+    join_seq(find_node(profile, "bw"), cat->bw, sizeof(cat->bw));
+    join_seq(find_node(profile, "guard"), cat->guard, sizeof(cat->guard));
+    YAMLNode *mcs = find_node(profile, "mcs");
+    for (size_t i = 0; mcs && i < mcs->num_children && cat->n_mcs < 16; i++)
+        if (mcs->children[i]->value) cat->mcs[cat->n_mcs++] = atoi(mcs->children[i]->value);
+    cat->max_mtu = node_int(profile, "max_mtu", 0);
+
+    YAMLNode *lm = find_node(profile, "link_modes");
+    for (size_t g = 0; lm && g < lm->num_children && cat->n_groups < LM_MAX_GROUPS; g++) {
+        YAMLNode *seq = lm->children[g];
+        link_group_t *grp = &cat->groups[cat->n_groups++];
+        grp->bandwidth_mhz = atoi(seq->key);      // "20mhz"
+        grp->n = 0;
+        for (size_t i = 0; i < seq->num_children && grp->n < LM_MAX_MODES; i++) {
+            const char *name = seq->children[i]->value;
+            const link_mode_t *m = name ? link_mode_find(cat, name) : NULL;
+            if (m) grp->modes[grp->n++] = m - cat->modes;
+        }
+    }
+}
+
+// For each overhead preset pick the k/n whose parity share (n-k)/n is the
+// largest not above it; among equal shares prefer k nearest
+// LM_FEC_PREFERRED_K.
+static void pick_fec(link_catalog_t *cat) {
+    for (int i = 0; i < cat->n_overheads; i++) {
+        int best_k = 1, best_n = 1;
+        for (int n = 1; n <= LM_FEC_MAX_N; n++) {
+            for (int k = 1; k <= n; k++) {
+                if ((n - k) * 100 > cat->overheads[i] * n) continue;
+                long lhs = (long)(n - k) * best_n, rhs = (long)(best_n - best_k) * n;
+                if (lhs > rhs || (lhs == rhs && abs(k - LM_FEC_PREFERRED_K) < abs(best_k - LM_FEC_PREFERRED_K))) {
+                    best_k = k;
+                    best_n = n;
+                }
+            }
+        }
+        cat->fec_k[i] = best_k;
+        cat->fec_n[i] = best_n;
+    }
+}
+
+// Walk each group from most to least robust (profile order, and within a
+// mode from most to least FEC parity) and keep every combination that
+// carries more than all before it. The kept rates are strictly increasing,
+// so the most robust choice for a bitrate is the first entry that fits.
+static void build_frontiers(link_catalog_t *cat) {
+    for (int g = 0; g < cat->n_groups; g++) {
+        link_group_t *grp = &cat->groups[g];
+        double best = 0;
+        grp->n_frontier = 0;
+        for (int i = 0; i < grp->n; i++) {
+            const link_mode_t *m = &cat->modes[grp->modes[i]];
+            for (int o = cat->n_overheads - 1; o >= 0; o--) {
+                double rate = m->net_rate_mbps[o];
+                if (rate <= best) continue;
+                link_choice_t *c = &grp->frontier[grp->n_frontier++];
+                c->mode = grp->modes[i];
+                c->overhead = cat->overheads[o];
+                c->fec_k = cat->fec_k[o];
+                c->fec_n = cat->fec_n[o];
+                c->mlink = cat->max_mtu && m->mlink > cat->max_mtu ? cat->max_mtu : m->mlink;
+                c->net_rate_mbps = rate;
+                best = rate;
+            }
+        }
+    }
+}
+
+int link_catalog_load(link_catalog_t *cat, const char *modes_file,
+                      const char *adapters_file, const char *wfb_file) {
+    memset(cat, 0, sizeof(*cat));
+    cat->files[0] = modes_file ? modes_file : LINK_MODES_YAML;
+    cat->files[1] = adapters_file ? adapters_file : LINK_ADAPTERS_YAML;
+    cat->files[2] = wfb_file ? wfb_file : LINK_WFB_YAML;
+    for (int i = 0; i < 3; i++) file_mtime(cat->files[i], &cat->mtimes[i]);
+
+    YAMLNode *root = yaml_load(cat->files[0]);
+    if (!root) return -1;
+    load_overheads(cat, root);
+    YAMLNode *modes = find_node(root, ".link_modes.modes");
+    for (size_t i = 0; modes && i < modes->num_children && cat->n_modes < LM_MAX_MODES; i++)
+        if (modes->children[i]->type == YAML_NODE_MAPPING)
+            load_mode(cat, modes->children[i]);
+    free_node(root);
+    if (!cat->n_modes) return -1;
+
+    root = yaml_load(cat->files[2]);
+    const char *adapter = root ? node_str(root, ".wireless.wlan_adapter") : NULL;
+    snprintf(cat->adapter, sizeof(cat->adapter), "%s", adapter ? adapter : "default");
+    free_node(root);
+
+    root = yaml_load(cat->files[1]);
+    YAMLNode *profiles = root ? find_node(root, ".profiles") : NULL;
+    YAMLNode *profile = profiles ? find_child(profiles, cat->adapter, strlen(cat->adapter),
+                                              yaml_key_hash(cat->adapter, strlen(cat->adapter))) : NULL;
+    if (profile) load_adapter(cat, profile);
+    free_node(root);
+    pick_fec(cat);
+    build_frontiers(cat);
+    return profile ? 0 : -1;
+}
+
+int link_catalog_refresh(link_catalog_t *cat) {
+    int changed = !cat->n_modes;
+    for (int i = 0; i < 3 && !changed; i++) {
+        struct timespec ts;
+        file_mtime(cat->files[i], &ts);
+        changed = ts.tv_sec != cat->mtimes[i].tv_sec || ts.tv_nsec != cat->mtimes[i].tv_nsec;
+    }
+    if (!changed) return 0;
+    const char *m = cat->files[0], *a = cat->files[1], *w = cat->files[2];
+    return link_catalog_load(cat, m, a, w);
+}
+
+const link_mode_t *link_mode_find(const link_catalog_t *cat, const char *name) {
+    for (int i = 0; i < cat->n_modes; i++)
+        if (strcmp(cat->modes[i].name, name) == 0) return &cat->modes[i];
+    return NULL;
+}
+
+const link_group_t *link_catalog_group(const link_catalog_t *cat, int bandwidth_mhz) {
+    for (int i = 0; i < cat->n_groups; i++)
+        if (cat->groups[i].bandwidth_mhz == bandwidth_mhz) return &cat->groups[i];
+    return NULL;
+}
+
+double link_mode_net_rate(const link_catalog_t *cat, const link_mode_t *mode, int overhead_pct) {
+    for (int i = 0; i < cat->n_overheads; i++)
+        if (cat->overheads[i] >= overhead_pct && mode->net_rate_mbps[i] > 0)
+            return mode->net_rate_mbps[i];
+    // No column that large: scale the raw rate instead.
+    return mode->raw_rate_mbps * (100 - overhead_pct) / 100.0;
+}
+
+#define APPENDF(...) do { \
+    int n_ = snprintf(buf + off, size - off, __VA_ARGS__); \
+    if (n_ < 0 || (size_t)n_ >= size - off) return -1; \
+    off += n_; \
+} while (0)
+
+int link_catalog_list(const link_catalog_t *cat, char *buf, size_t size) {
+    static const int widths[] = { 10, 20, 40 };
+    size_t off = 0;
+    buf[0] = '\0';
+    for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+        APPENDF("%s=== %dmhz ===", off ? "\n" : "", widths[w]);
+        const link_group_t *g = link_catalog_group(cat, widths[w]);
+        for (int i = 0; g && i < g->n; i++) {
+            const link_mode_t *m = &cat->modes[g->modes[i]];
+            APPENDF("\n  %-18s ~%6.1f Mbps  MTU:%4d", m->name,
+                    link_mode_net_rate(cat, m, LM_DEFAULT_OVERHEAD), m->mlink);
+        }
+    }
+    return 0;
+}
+
+static void group_names(const link_catalog_t *cat, int bw, char *out, size_t size) {
+    const link_group_t *g = link_catalog_group(cat, bw);
+    size_t off = 0;
+    out[0] = '\0';
+    for (int i = 0; g && i < g->n; i++) {
+        int n = snprintf(out + off, size - off, "%s%s", off ? "," : "", cat->modes[g->modes[i]].name);
+        if (n < 0 || (size_t)n >= size - off) break;
+        off += n;
+    }
+}
+
+int link_catalog_info(const link_catalog_t *cat, char *buf, size_t size) {
+    size_t off = 0;
+    char mcs[64] = "";
+    int contiguous = cat->n_mcs > 0 && cat->mcs[cat->n_mcs - 1] - cat->mcs[0] + 1 == cat->n_mcs;
+    if (contiguous) {
+        snprintf(mcs, sizeof(mcs), "%d-%d", cat->mcs[0], cat->mcs[cat->n_mcs - 1]);
+    } else {
+        size_t o = 0;
+        for (int i = 0; i < cat->n_mcs && o < sizeof(mcs); i++)
+            o += snprintf(mcs + o, sizeof(mcs) - o, "%s%d", i ? "," : "", cat->mcs[i]);
+    }
+    char lm10[512], lm20[512], lm40[512];
+    group_names(cat, 10, lm10, sizeof(lm10));
+    group_names(cat, 20, lm20, sizeof(lm20));
+    group_names(cat, 40, lm40, sizeof(lm40));
+    APPENDF("adapter=%s;bw=%s;guard=%s;mcs=%s;max_mtu=%d;link_modes_10=%s;link_modes_20=%s;link_modes_40=%s",
+            cat->adapter, cat->bw, cat->guard, mcs, cat->max_mtu, lm10, lm20, lm40);
+
+    // Live wfb settings are read fresh, they change at runtime.
+    static const char *const keys[][2] = {
+        { "width", ".wireless.width" }, { "channel", ".wireless.channel" },
+        { "txpower", ".wireless.txpower" }, { "mlink", ".wireless.mlink" },
+        { "link_control", ".wireless.link_control" }, { "fec_k", ".broadcast.fec_k" },
+        { "fec_n", ".broadcast.fec_n" }, { "stbc", ".broadcast.stbc" },
+        { "ldpc", ".broadcast.ldpc" },
+    };
+    YAMLNode *wfb = yaml_load(cat->files[2]);
+    APPENDF("\nwfb=");
+    for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+        const char *v = wfb ? node_str(wfb, keys[i][1]) : NULL;
+        int n = snprintf(buf + off, size - off, "%s%s=%s", i ? ";" : "", keys[i][0], v ? v : "");
+        if (n < 0 || (size_t)n >= size - off) { free_node(wfb); return -1; }
+        off += n;
+    }
+    free_node(wfb);
+    return 0;
+}
+
+int link_catalog_get_auto(const link_catalog_t *cat, int width_mhz, int kbps,
+                          char *buf, size_t size) {
+    double required = (double)kbps * LM_FEC_N / LM_FEC_K / 1024;
+    const link_group_t *g = link_catalog_group(cat, width_mhz);
+    for (int i = 0; g && i < g->n; i++) {
+        const link_mode_t *m = &cat->modes[g->modes[i]];
+        double rate = link_mode_net_rate(cat, m, LM_DEFAULT_OVERHEAD);
+        if (rate >= required) {
+            snprintf(buf, size, "%s (net%d≈%.1f Mbps, MTU:%d)", m->name,
+                     LM_DEFAULT_OVERHEAD, rate, m->mlink);
+            return 0;
+        }
+    }
+    snprintf(buf, size, "No mode fits %d kbps in %dmhz with FEC %d/%d.",
+             kbps, width_mhz, LM_FEC_K, LM_FEC_N);
+    return -1;
+}
+
+int link_catalog_solve(const link_catalog_t *cat, int width_mhz, int kbps, link_choice_t *out) {
+    const link_group_t *g = link_catalog_group(cat, width_mhz);
+    if (!g || !g->n_frontier) return -1;
+    double need = kbps / 1024.0;
+    int lo = 0, hi = g->n_frontier;       // first entry with rate >= need
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (g->frontier[mid].net_rate_mbps >= need) hi = mid;
+        else lo = mid + 1;
+    }
+    if (lo == g->n_frontier) return -1;
+    *out = g->frontier[lo];
+    return 0;
+}
+
+int link_choice_format(const link_catalog_t *cat, const link_choice_t *c, char *buf, size_t size) {
+    const link_mode_t *m = &cat->modes[c->mode];
+    int n = snprintf(buf, size, "mode=%s mcs=%d bw=%d gi=%s fec_k=%d fec_n=%d mlink=%d net_mbps=%.1f",
+                     m->name, m->mcs, m->bandwidth_mhz, m->short_gi ? "short" : "long",
+                     c->fec_k, c->fec_n, c->mlink, c->net_rate_mbps);
+    return n < 0 || (size_t)n >= size ? -1 : 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * link_modes.h - link mode catalog from link_modes.yaml and wlan_adapters.yaml
+ *
+ * Every mode of /etc/link_modes.yaml and the active adapter's profile from
+ * /etc/wlan_adapters.yaml are loaded once into flat, typed tables, so listing
+ * modes or picking one for a bitrate costs no yaml-cli or bc forks. Answers
+ * the queries of datalink_manager.sh --list-modes, --info and --get-auto.
+ * A catalog is plain data: callers that share one between threads lock it.
+ */
+#ifndef LINK_MODES_H
+#define LINK_MODES_H
+
+#include <stddef.h>
+#include <time.h>
+
+#include "sysroot.h"
+
+#define LINK_MODES_YAML AIR_MAN_SYSROOT "/etc/link_modes.yaml"
+#define LINK_ADAPTERS_YAML AIR_MAN_SYSROOT "/etc/wlan_adapters.yaml"
+#define LINK_WFB_YAML AIR_MAN_SYSROOT "/etc/wfb.yaml"
+
+#define LM_MAX_OVERHEADS 8
+#define LM_MAX_MODES 64
+#define LM_MAX_GROUPS 4           // 10/20/40/80 MHz
+#define LM_DEFAULT_OVERHEAD 30    // net_rate_mbps column for list/get-auto
+#define LM_FEC_MAX_N 12           // largest FEC block the solver proposes
+#define LM_FEC_PREFERRED_K 8      // tie-break between k/n with the same ratio
+
+typedef struct {
+    char name[32];                // e.g. "mcs2_20mhz_lgi"
+    int mcs;
+    int bandwidth_mhz;
+    int short_gi;
+    double raw_rate_mbps;
+    double net_rate_mbps[LM_MAX_OVERHEADS];   // same order as overheads[]; 0 = missing
+    int mlink;
+} link_mode_t;
+
+// One (mode, FEC, mlink) combination proposed by the solver.
+typedef struct {
+    int mode;                     // index into link_catalog_t.modes
+    int overhead;                 // net_rate_mbps column used, percent
+    int fec_k, fec_n;
+    int mlink;                    // mode's mlink capped at the adapter's max_mtu
+    double net_rate_mbps;         // rate left for video
+} link_choice_t;
+
+// Modes the adapter supports at one channel width, in profile order.
+typedef struct {
+    int bandwidth_mhz;
+    int n;
+    int modes[LM_MAX_MODES];      // indices into link_catalog_t.modes
+    // Solver table: the combinations that are the most robust way to carry
+    // some bitrate, sorted by strictly increasing net_rate_mbps.
+    link_choice_t frontier[LM_MAX_MODES * LM_MAX_OVERHEADS];
+    int n_frontier;
+} link_group_t;
+
+typedef struct {
+    int overheads[LM_MAX_OVERHEADS];   // overhead_presets, percent, ascending
+    int n_overheads;
+    int fec_k[LM_MAX_OVERHEADS];       // FEC used for each overhead preset
+    int fec_n[LM_MAX_OVERHEADS];
+    link_mode_t modes[LM_MAX_MODES];
+    int n_modes;
+
+    char adapter[64];             // .wireless.wlan_adapter from wfb.yaml
+    char bw[64], guard[64];       // adapter capabilities, comma-separated
+    int mcs[16];
+    int n_mcs;
+    int max_mtu;
+    link_group_t groups[LM_MAX_GROUPS];
+    int n_groups;
+
+    // Source files and their mtimes at load, for link_catalog_refresh().
+    const char *files[3];         // modes, adapters, wfb
+    struct timespec mtimes[3];
+} link_catalog_t;
+
+// Load the catalog; NULL file names select the defaults above. Returns 0,
+// or -1 if link_modes.yaml or the adapter profile can't be read.
+int link_catalog_load(link_catalog_t *cat, const char *modes_file,
+                      const char *adapters_file, const char *wfb_file);
+// Reload if any source file changed since the last load. Returns 0 if the
+// catalog is usable.
+int link_catalog_refresh(link_catalog_t *cat);
+
+const link_mode_t *link_mode_find(const link_catalog_t *cat, const char *name);
+const link_group_t *link_catalog_group(const link_catalog_t *cat, int bandwidth_mhz);
+// Net rate of mode at the smallest overhead preset >= overhead_pct.
+double link_mode_net_rate(const link_catalog_t *cat, const link_mode_t *mode, int overhead_pct);
+
+// Text replies, formatted like datalink_manager.sh. Return 0 on success.
+int link_catalog_list(const link_catalog_t *cat, char *buf, size_t size);
+int link_catalog_info(const link_catalog_t *cat, char *buf, size_t size);
+// First mode of the width_mhz group whose net rate carries kbps with FEC
+// 8/12 on top. Returns 0 if one fits, -1 otherwise (buf says why).
+int link_catalog_get_auto(const link_catalog_t *cat, int width_mhz, int kbps,
+                          char *buf, size_t size);
+
+// Most robust combination at width_mhz that carries kbps: the earliest mode
+// of the group (then the most FEC parity) whose net rate is enough. Reads
+// net_rate_mbps[p] as the rate left for video when p percent of the airtime
+// is FEC parity, so each overhead preset maps to one k/n. A binary search
+// over the group's frontier. Returns 0, or -1 if nothing fits.
+int link_catalog_solve(const link_catalog_t *cat, int width_mhz, int kbps, link_choice_t *out);
+// "mode=... mcs=... bw=... gi=... fec_k=... fec_n=... mlink=... net_mbps=..."
+int link_choice_format(const link_catalog_t *cat, const link_choice_t *c, char *buf, size_t size);
+
+#endif /* LINK_MODES_H */
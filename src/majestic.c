@@ -0,0 +1,125 @@
+/*
+ * majestic.c - minimal HTTP client and process control for majestic
+ *
+ * Only what air_man needs: one short-lived HTTP/1.0 GET per call against
+ * 127.0.0.1, bounded by MAJESTIC_HTTP_TIMEOUT_MS, and a /proc scan to find
+ * majestic's PID for SIGHUP instead of running killall.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "majestic.h"
+
+static int http_connect(void) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    struct timeval tv = {
+        .tv_sec = MAJESTIC_HTTP_TIMEOUT_MS / 1000,
+        .tv_usec = (MAJESTIC_HTTP_TIMEOUT_MS % 1000) * 1000
+    };
+    // SO_SNDTIMEO also bounds connect() on Linux
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(MAJESTIC_HTTP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK)
+    };
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int majestic_http_get(const char *path, char *body, size_t body_size) {
+    int fd = http_connect();
+    if (fd < 0) return -1;
+
+    char req[1024];
+    int len = snprintf(req, sizeof(req),
+                       "GET %s HTTP/1.0\r\nHost: localhost\r\nConnection: close\r\n\r\n", path);
+    if (len < 0 || len >= (int)sizeof(req)) { close(fd); return -1; }
+    for (int off = 0; off < len; ) {
+        ssize_t n = send(fd, req + off, len - off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            close(fd);
+            return -1;
+        }
+        off += n;
+    }
+
+    // Read the whole reply (it's small) and pick out status and body.
+    char resp[4096];
+    size_t got = 0;
+    for (;;) {
+        ssize_t n = recv(fd, resp + got, sizeof(resp) - 1 - got, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += n;
+        if (got == sizeof(resp) - 1) break;
+    }
+    close(fd);
+    resp[got] = '\0';
+
+    int status;
+    if (sscanf(resp, "HTTP/%*d.%*d %d", &status) != 1) return -1;
+    if (body && body_size) {
+        char *p = strstr(resp, "\r\n\r\n");
+        snprintf(body, body_size, "%s", p ? p + 4 : "");
+    }
+    return status;
+}
+
+int majestic_set(const char *query) {
+    char path[1024];
+    if (snprintf(path, sizeof(path), "/api/v1/set?%s", query) >= (int)sizeof(path))
+        return -1;
+    int status = majestic_http_get(path, NULL, 0);
+    return (status >= 200 && status < 300) ? 0 : -1;
+}
+
+pid_t majestic_pid(void) {
+    DIR *d = opendir("/proc");
+    if (!d) return -1;
+    pid_t pid = -1;
+    struct dirent *e;
+    while ((e = readdir(d)) != NULL) {
+        if (!isdigit((unsigned char)e->d_name[0])) continue;
+        char path[300], comm[32];
+        snprintf(path, sizeof(path), "/proc/%s/comm", e->d_name);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        ssize_t n = read(fd, comm, sizeof(comm) - 1);
+        close(fd);
+        if (n <= 0) continue;
+        comm[n] = '\0';
+        comm[strcspn(comm, "\n")] = '\0';
+        if (strcmp(comm, "majestic") == 0) {
+            pid = atoi(e->d_name);
+            break;
+        }
+    }
+    closedir(d);
+    return pid;
+}
+
+int majestic_reload(void) {
+    pid_t pid = majestic_pid();
+    if (pid <= 0) return -1;
+    return kill(pid, SIGHUP);
+}
@@ -0,0 +1,34 @@
+/*
+ * majestic.h - talk to the local majestic streamer without forking
+ *
+ * majestic_set() sends the same GET /api/v1/set?... requests as alink's
+ * command templates (see /etc/alink.conf), over a plain loopback socket.
+ * majestic_reload() SIGHUPs the running majestic found in /proc.
+ */
+#ifndef MAJESTIC_H
+#define MAJESTIC_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "sysroot.h"
+
+#define MAJESTIC_CONFIG AIR_MAN_SYSROOT "/etc/majestic.yaml"
+#define MAJESTIC_HTTP_PORT 80
+#define MAJESTIC_HTTP_TIMEOUT_MS 1000
+
+// GET path (e.g. "/api/v1/set?video0.fps=60") from majestic. The body, if
+// body is non-NULL, is copied NUL-terminated. Returns the HTTP status code,
+// or -1 if majestic could not be reached.
+int majestic_http_get(const char *path, char *body, size_t body_size);
+
+// Apply "key=value&key=value" live through /api/v1/set. Returns 0 on a 2xx.
+int majestic_set(const char *query);
+
+// PID of the running majestic, or -1.
+pid_t majestic_pid(void);
+
+// Ask majestic to reload its config (SIGHUP). Returns 0 if it was signalled.
+int majestic_reload(void);
+
+#endif /* MAJESTIC_H */
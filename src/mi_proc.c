@@ -0,0 +1,102 @@
+/*
+ * mi_proc.c - SigmaStar mi_modules procfs controls (see mi_proc.h)
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <libgen.h>
+#include <sys/stat.h>
+
+#include "mi_proc.h"
+
+int mi_proc_write(const char *node, const char *cmd) {
+    char buf[128];
+    int len = snprintf(buf, sizeof(buf), "%s\n", cmd);
+    if (len < 0 || (size_t)len >= sizeof(buf)) return -EINVAL;
+    int fd = open(node, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) return -errno;
+    // The drivers parse one command per write(), so never split it.
+    ssize_t n;
+    do n = write(fd, buf, len); while (n < 0 && errno == EINTR);
+    int rc = n < 0 ? -errno : n == len ? 0 : -EIO;
+    close(fd);
+    return rc;
+}
+
+int mi_set_precrop(const char *crop) {
+    char cmd[96];
+    snprintf(cmd, sizeof(cmd), "setprecrop %s", crop);
+    return mi_proc_write(MI_VPE_PROC, cmd);
+}
+
+int mi_set_fps(int fps) {
+    char cmd[32];
+    snprintf(cmd, sizeof(cmd), "setfps 0 %d", fps);
+    return mi_proc_write(MI_SENSOR_PROC, cmd);
+}
+
+int mi_vpe_channels(void) {
+    FILE *f = fopen(MI_VPE_PROC, "r");
+    if (!f) return -errno;
+    char line[512];
+    int in_table = 0, n = 0;
+    while (fgets(line, sizeof(line), f)) {
+        const char *s = line + strspn(line, " \t");
+        if (strstr(s, "ChnId")) {
+            in_table = 1;
+            continue;
+        }
+        if (!in_table) continue;
+        if (*s >= '0' && *s <= '9') n++;
+        else in_table = 0;          // blank line or the next section
+    }
+    fclose(f);
+    return n;
+}
+
+int precrop_state_load(char *crop, size_t size) {
+    FILE *f = fopen(PRECROP_STATE_FILE, "r");
+    if (!f) return -1;
+    char line[96];
+    int rc = fgets(line, sizeof(line), f) ? 0 : -1;
+    fclose(f);
+    if (rc == 0) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (!line[0]) return -1;
+        snprintf(crop, size, "%s", line);
+    }
+    return rc;
+}
+
+// Temp file in the same directory, fsync, rename over the old one, fsync
+// the directory: a power cut leaves either the old or the new crop.
+int precrop_state_save(const char *crop) {
+    char tmp[PATH_MAX], line[96], dir[PATH_MAX];
+    int len = snprintf(line, sizeof(line), "%s\n", crop);
+    if (len < 0 || (size_t)len >= sizeof(line)) return -1;
+    snprintf(tmp, sizeof(tmp), "%s.XXXXXX", PRECROP_STATE_FILE);
+    int fd = mkstemp(tmp);
+    if (fd < 0) return -1;
+    if (fchmod(fd, 0644) != 0 || write(fd, line, len) != len || fsync(fd) != 0) {
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    if (close(fd) != 0 || rename(tmp, PRECROP_STATE_FILE) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    snprintf(dir, sizeof(dir), "%s", PRECROP_STATE_FILE);
+    int dfd = open(dirname(dir), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd >= 0) {
+        fsync(dfd);
+        close(dfd);
+    }
+    return 0;
+}
@@ -0,0 +1,41 @@
+/*
+ * mi_proc.h - SigmaStar mi_modules procfs controls without a shell
+ *
+ * The sensor and VPE drivers take text commands written to their procfs
+ * nodes, e.g. "echo setprecrop 0 0 1920 1080 > .../mi_vpe0". These calls do
+ * the open/write directly and return 0 or a negative errno.
+ *
+ * The pre-crop does not survive a majestic restart or a reboot, so the
+ * crop in effect is kept in PRECROP_STATE_FILE (one line, "nocrop" or the
+ * setprecrop arguments), replaced atomically; air_man re-applies it on start.
+ */
+#ifndef MI_PROC_H
+#define MI_PROC_H
+
+#include <stddef.h>
+
+#include "sysroot.h"
+
+#define MI_VPE_PROC AIR_MAN_SYSROOT "/proc/mi_modules/mi_vpe/mi_vpe0"
+#define MI_SENSOR_PROC AIR_MAN_SYSROOT "/proc/mi_modules/mi_sensor/mi_sensor0"
+#define PRECROP_STATE_FILE AIR_MAN_SYSROOT "/etc/air_man.precrop"
+
+// Write cmd (a newline is added) to a procfs control node.
+int mi_proc_write(const char *node, const char *cmd);
+
+// "setprecrop <crop>" to the VPE; crop is the driver's argument list.
+int mi_set_precrop(const char *crop);
+// "setfps 0 <fps>" to the sensor, as alink's fpsCommandTemplate.
+int mi_set_fps(int fps);
+
+// Channels the VPE driver lists as created (rows under the "ChnId" header
+// of its dump), 0 while the pipeline is torn down, or a negative errno if
+// the node can't be read (not a SigmaStar SoC).
+int mi_vpe_channels(void);
+
+// Crop from the state file into crop; -1 if there is none.
+int precrop_state_load(char *crop, size_t size);
+// Replace the state file with crop. 0 on success, -1 otherwise.
+int precrop_state_save(const char *crop);
+
+#endif /* MI_PROC_H */
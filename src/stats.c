@@ -0,0 +1,194 @@
+/*
+ * stats.c - latency histograms and counters (see stats.h)
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "stats.h"
+
+#define STATS_MAX_CMDS 32       // distinct commands; the rest share "other"
+#define STATS_NAME_LEN 32
+#define HIST_SUB 4              // buckets per power of two
+#define HIST_BUCKETS 108        // up to 2^27 us (~134 s); slower samples land in the last one
+
+typedef struct {
+    unsigned long n;
+    unsigned long long max;
+    unsigned bucket[HIST_BUCKETS];
+} hist_t;
+
+typedef struct {
+    char name[STATS_NAME_LEN];
+    hist_t stage[STAT_STAGES];
+} cmd_stats_t;
+
+static const char *const stage_names[STAT_STAGES] = {
+    "parse", "queue", "exec", "child", "write"
+};
+static const char *const counter_names[STAT_COUNTERS] = {
+    "forks", "popens", "connections", "connections_total",
+    "conn_timeouts", "txn_timeouts", "reverts", "busy"
+};
+
+static struct {
+    pthread_mutex_t lock;
+    struct timespec start;
+    long counter[STAT_COUNTERS];
+    cmd_stats_t cmd[STATS_MAX_CMDS];
+    int n_cmds;
+} st = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+// Values below HIST_SUB get a bucket each; above that every power of two
+// is split into HIST_SUB equal buckets.
+static int bucket_of(unsigned long long us) {
+    if (us < HIST_SUB) return us;
+    int e = 63 - __builtin_clzll(us);                   // >= 2
+    int b = (e - 1) * HIST_SUB + (int)((us >> (e - 2)) & (HIST_SUB - 1));
+    return b < HIST_BUCKETS ? b : HIST_BUCKETS - 1;
+}
+
+// Largest value that falls in bucket b.
+static unsigned long long bucket_top(int b) {
+    if (b < HIST_SUB) return b;
+    int e = b / HIST_SUB + 1;
+    unsigned long long lo = (unsigned long long)(HIST_SUB + b % HIST_SUB) << (e - 2);
+    return lo + (1ULL << (e - 2)) - 1;
+}
+
+static unsigned long long percentile(const hist_t *h, int pct) {
+    unsigned long rank = (h->n * pct + 99) / 100, seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += h->bucket[b];
+        if (seen >= rank) {
+            unsigned long long top = bucket_top(b);
+            return top < h->max ? top : h->max;
+        }
+    }
+    return h->max;
+}
+
+// Slot for the first word of cmd. Caller holds st.lock.
+static cmd_stats_t *cmd_slot(const char *cmd) {
+    char name[STATS_NAME_LEN];
+    size_t len = 0;
+    while (cmd[len] && !isspace((unsigned char)cmd[len]) && len < sizeof(name) - 1) {
+        // Keys end up in JSON; keep them to plain identifier characters.
+        unsigned char ch = cmd[len];
+        name[len] = isalnum(ch) || ch == '_' || ch == '-' ? ch : '_';
+        len++;
+    }
+    name[len] = '\0';
+    if (!len) snprintf(name, sizeof(name), "other");
+
+    for (int i = 0; i < st.n_cmds; i++)
+        if (strcmp(st.cmd[i].name, name) == 0) return &st.cmd[i];
+    // Keep the last slot for "other" so stray input can't crowd out
+    // the commands we care about.
+    if (st.n_cmds < STATS_MAX_CMDS - 1 || (st.n_cmds < STATS_MAX_CMDS && strcmp(name, "other") == 0)) {
+        cmd_stats_t *s = &st.cmd[st.n_cmds++];
+        snprintf(s->name, sizeof(s->name), "%s", name);
+        return s;
+    }
+    return strcmp(name, "other") == 0 ? NULL : cmd_slot("other");
+}
+
+void stats_init(void) {
+    clock_gettime(CLOCK_MONOTONIC, &st.start);
+}
+
+void stats_record(const char *cmd, stat_stage_t stage, long long us) {
+    if (us < 0) us = 0;
+    pthread_mutex_lock(&st.lock);
+    cmd_stats_t *s = cmd_slot(cmd);
+    if (s) {
+        hist_t *h = &s->stage[stage];
+        h->n++;
+        h->bucket[bucket_of(us)]++;
+        if ((unsigned long long)us > h->max) h->max = us;
+    }
+    pthread_mutex_unlock(&st.lock);
+}
+
+void stats_count(stat_counter_t c, long delta) {
+    pthread_mutex_lock(&st.lock);
+    st.counter[c] += delta;
+    pthread_mutex_unlock(&st.lock);
+}
+
+void stats_reset(void) {
+    pthread_mutex_lock(&st.lock);
+    long conns = st.counter[STAT_CONNS];
+    memset(st.counter, 0, sizeof(st.counter));
+    st.counter[STAT_CONNS] = conns;
+    memset(st.cmd, 0, sizeof(st.cmd));
+    st.n_cmds = 0;
+    clock_gettime(CLOCK_MONOTONIC, &st.start);
+    pthread_mutex_unlock(&st.lock);
+}
+
+static long uptime_s(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec - st.start.tv_sec;
+}
+
+void stats_format(char *buf, size_t size, const char *filter) {
+    size_t n = 0;
+#define PUT(...) do { if (n < size) n += snprintf(buf + n, size - n, __VA_ARGS__); } while (0)
+    pthread_mutex_lock(&st.lock);
+    PUT("since %lds:", uptime_s());
+    for (int c = 0; c < STAT_COUNTERS; c++) PUT(" %s=%ld", counter_names[c], st.counter[c]);
+    for (int i = 0; i < st.n_cmds; i++) {
+        const cmd_stats_t *s = &st.cmd[i];
+        if (filter && strncmp(s->name, filter, strlen(filter)) != 0) continue;
+        for (int k = 0; k < STAT_STAGES; k++) {
+            const hist_t *h = &s->stage[k];
+            if (!h->n) continue;
+            PUT("\n%s %s n=%lu p50=%lluus p95=%lluus p99=%lluus max=%lluus",
+                s->name, stage_names[k], h->n, percentile(h, 50), percentile(h, 95),
+                percentile(h, 99), h->max);
+        }
+    }
+    pthread_mutex_unlock(&st.lock);
+#undef PUT
+}
+
+int stats_dump_json(const char *path) {
+    char tmp[256];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    if (!f) return -1;
+
+    pthread_mutex_lock(&st.lock);
+    fprintf(f, "{\"uptime_s\":%ld,\"counters\":{", uptime_s());
+    for (int c = 0; c < STAT_COUNTERS; c++)
+        fprintf(f, "%s\"%s\":%ld", c ? "," : "", counter_names[c], st.counter[c]);
+    fprintf(f, "},\"commands\":{");
+    for (int i = 0; i < st.n_cmds; i++) {
+        const cmd_stats_t *s = &st.cmd[i];
+        fprintf(f, "%s\"%s\":{", i ? "," : "", s->name);
+        int first = 1;
+        for (int k = 0; k < STAT_STAGES; k++) {
+            const hist_t *h = &s->stage[k];
+            if (!h->n) continue;
+            fprintf(f, "%s\"%s\":{\"n\":%lu,\"p50_us\":%llu,\"p95_us\":%llu,\"p99_us\":%llu,\"max_us\":%llu}",
+                    first ? "" : ",", stage_names[k], h->n, percentile(h, 50),
+                    percentile(h, 95), percentile(h, 99), h->max);
+            first = 0;
+        }
+        fprintf(f, "}");
+    }
+    fprintf(f, "}}\n");
+    pthread_mutex_unlock(&st.lock);
+
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
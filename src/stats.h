@@ -0,0 +1,57 @@
+/*
+ * stats.h - latency histograms and counters for air_man
+ *
+ * Every command is timed in up to five stages, keyed by its first word
+ * ("change_mcs", "get", ...):
+ *   parse  - line taken off the input buffer until it is dispatched
+ *   queue  - waiting in a worker lane, and for an early ACK to drain
+ *   exec   - process_command (or the inline handler) itself
+ *   child  - the part of exec spent in system()/popen() children
+ *   write  - framing the reply and handing it to the socket
+ * Each stage keeps a log-linear histogram (four buckets per power of two,
+ * so percentiles are within 25%) plus the exact maximum. All calls are
+ * thread safe.
+ */
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+
+#define STATS_JSON_PATH "/tmp/air_man_stats.json"
+
+typedef enum {
+    STAT_PARSE,
+    STAT_QUEUE,
+    STAT_EXEC,
+    STAT_CHILD,
+    STAT_WRITE,
+    STAT_STAGES
+} stat_stage_t;
+
+typedef enum {
+    STAT_FORKS,             // system() calls
+    STAT_POPENS,            // popen() calls
+    STAT_CONNS,             // connections open now
+    STAT_CONNS_TOTAL,       // connections accepted
+    STAT_CONN_TIMEOUTS,     // idle connections dropped
+    STAT_TXN_TIMEOUTS,      // changes not confirmed in time
+    STAT_REVERTS,           // changes rolled back (timeouts and failed link profiles)
+    STAT_BUSY,              // commands or connections turned away
+    STAT_COUNTERS
+} stat_counter_t;
+
+void stats_init(void);
+// Add one sample of us microseconds to stage of command cmd.
+void stats_record(const char *cmd, stat_stage_t stage, long long us);
+void stats_count(stat_counter_t c, long delta);
+// Forget all samples; gauges (STAT_CONNS) are kept.
+void stats_reset(void);
+
+// Counters, then one line per command and stage:
+// "<cmd> <stage> n=<n> p50=<us>us p95=<us>us p99=<us>us max=<us>us".
+// Only commands starting with filter (NULL = all) are listed.
+void stats_format(char *buf, size_t size, const char *filter);
+// Same data as JSON, written to path through a temp file and rename().
+int stats_dump_json(const char *path);
+
+#endif /* STATS_H */
@@ -0,0 +1,124 @@
+/*
+ * stupid-yaml.h - minimal YAML tree used by yaml-cli and air_man
+ *
+ * Supports the subset described in stupid-yaml.c: nested mappings, dash and
+ * inline sequences, inline mappings and '|' block literals. Paths are
+ * dot-separated keys; leading dots (".wireless.channel") are allowed.
+ *
+ * A document lives in one arena: nodes and strings are never freed one by
+ * one, free_node() on the document root releases everything at once.
+ */
+#ifndef STUPID_YAML_H
+#define STUPID_YAML_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+typedef enum {
+    YAML_NODE_SCALAR,
+    YAML_NODE_MAPPING,
+    YAML_NODE_SEQUENCE
+} YAMLNodeType;
+
+typedef struct YAMLArena YAMLArena;
+
+typedef struct YAMLNode {
+    char *key;                   /* For mapping nodes; NULL for sequence items */
+    char *value;                 /* For scalar values */
+    YAMLNodeType type;
+    struct YAMLNode **children;
+    size_t num_children;
+    size_t children_cap;
+    int force_inline;            /* For sequences: if nonzero, dump inline as [a,b,c] */
+    struct YAMLIndex *index;     /* Mappings with many children: key hash table, built lazily */
+    YAMLArena *arena;            /* document the node belongs to */
+} YAMLNode;
+
+/* Mappings with at least this many children get a hash index on first lookup. */
+#define YAML_INDEX_MIN_CHILDREN 8
+
+/* A dot-separated path split into keys once, for repeated lookups. */
+typedef struct {
+    size_t num_segments;
+    struct YAMLPathSegment {
+        const char *key;
+        size_t len;
+        uint32_t hash;
+    } *segments;
+    char *buf;                   /* owns the key strings */
+} YAMLPath;
+
+/* Tree construction */
+/* New empty document: a "root" mapping owning a fresh arena. */
+YAMLNode *yaml_new_document(void);
+/* Node with copies of key/value allocated in arena (root->arena). */
+YAMLNode *create_node(YAMLArena *arena, const char *key, const char *value);
+void add_child(YAMLNode *parent, YAMLNode *child);
+/* Frees the whole document when given its root; no-op for other nodes. */
+void free_node(YAMLNode *node);
+
+/* Parse f into root (from yaml_new_document()); the text is kept in the
+   arena. Returns 0 on success, -1 on a syntax error (reported on stderr). */
+int parse_yaml(FILE *f, YAMLNode *root);
+/* Parse a whole file into a new "root" mapping; NULL on error. */
+YAMLNode *yaml_load(const char *filename);
+
+/* Path access */
+YAMLPath *yaml_path_compile(const char *path);
+void yaml_path_free(YAMLPath *path);
+YAMLNode *find_node_path(YAMLNode *node, const YAMLPath *path);
+YAMLNode *find_child(YAMLNode *parent, const char *key, size_t len, uint32_t hash);
+uint32_t yaml_key_hash(const char *key, size_t len);
+YAMLNode *find_node(YAMLNode *node, const char *path);
+YAMLNode *find_or_create_node(YAMLNode *node, const char *path);
+int delete_node_at_path(YAMLNode *node, const char *path);
+/* Copy the value at path into buf: scalars as-is, containers in inline
+ * form ([a,b] / {k:v}). Returns 0 if found, -1 otherwise. */
+int yaml_get_value(YAMLNode *root, const char *path, char *buf, size_t size);
+/* Set path to value, creating parents. '[...]' and '{...}' values become
+ * containers; dash selects dash notation for lists. Returns 0 on success. */
+int yaml_set_value(YAMLNode *root, const char *path, const char *value, int dash);
+
+/* Output */
+void print_inline_yaml(FILE *f, const YAMLNode *node);
+void print_yaml(const YAMLNode *node, int depth);
+void dump_yaml_node(FILE *f, const YAMLNode *node, int indent);
+/* Atomically replace filename (temp file + fsync + rename); a no-op if the
+   contents are unchanged. Returns 0 on success, -1 on error (errno set). */
+int save_yaml(const char *filename, const YAMLNode *root);
+/* Advisory flock shared by every process editing filename; hold it
+   exclusively across load-modify-save. Returns a fd for yaml_unlock(),
+   or -1 if the lock file can't be opened (callers carry on unlocked). */
+int yaml_lock(const char *filename, int exclusive);
+void yaml_unlock(int fd);
+/* mtime of file into *ts, or zero if it can't be stat'ed; for callers that
+   reload a file of their own when it changes. */
+void file_mtime(const char *file, struct timespec *ts);
+
+/*
+ * YAMLCache keeps one parsed file in memory for a long-running process.
+ * Every access stats the file and reparses only if its mtime, size or
+ * inode changed, so edits made by yaml-cli or scripts are picked up without
+ * a fork. All calls are serialized on the cache's own lock.
+ */
+typedef struct {
+    const char *filename;
+    YAMLNode *root;
+    struct timespec mtime;
+    off_t size;
+    ino_t ino;
+    pthread_mutex_t lock;
+} YAMLCache;
+
+#define YAML_CACHE_INIT(fn) { .filename = (fn), .lock = PTHREAD_MUTEX_INITIALIZER }
+
+int yaml_cache_get(YAMLCache *c, const char *path, char *buf, size_t size);
+/* Set a value and write the file back. Returns 0 on success. */
+int yaml_cache_set(YAMLCache *c, const char *path, const char *value);
+/* Set n values and write the file once. */
+int yaml_cache_set_many(YAMLCache *c, const char *const *paths, const char *const *values, size_t n);
+void yaml_cache_invalidate(YAMLCache *c);
+
+#endif /* STUPID_YAML_H */
@@ -0,0 +1,16 @@
+/*
+ * sysroot.h - where air_man finds the drone's files
+ *
+ * Every file air_man opens under /etc, /usr/bin or /proc/mi_modules is
+ * named as AIR_MAN_SYSROOT "/etc/...". On the drone the prefix is empty.
+ * bench/run.sh builds with -DAIR_MAN_SYSROOT='"<dir>"' so the same code
+ * runs on a PC against a copy of vtx/.
+ */
+#ifndef SYSROOT_H
+#define SYSROOT_H
+
+#ifndef AIR_MAN_SYSROOT
+#define AIR_MAN_SYSROOT ""
+#endif
+
+#endif /* SYSROOT_H */
@@ -0,0 +1,144 @@
+/*
+ * txprofiles.c - compiled /etc/txprofiles.conf (see txprofiles.h)
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stupid-yaml.h"
+#include "txprofiles.h"
+
+static const char *const txp_names[] = {
+    "gi", "mcs", "bandwidth", "fec", "bitrate", "gop", "power", "roi", "qpDelta"
+};
+
+static int valid_roi(const char *s) {
+    int a, b, c, d, end = 0;
+    return sscanf(s, "%d,%d,%d,%d%n", &a, &b, &c, &d, &end) == 4 && s[end] == '\0';
+}
+
+// Parse one table line into *p. Returns NULL or what is wrong with it.
+static const char *parse_line(const char *line, tx_profile_t *p) {
+    char gi[8];
+    int end = 0;
+    if (sscanf(line, "%d - %d %7s %d %d %d %d %d %d %31s %d %d %n",
+               &p->lo, &p->hi, gi, &p->mcs, &p->fec_k, &p->fec_n, &p->bitrate,
+               &p->gop, &p->power, p->roi_qp, &p->bandwidth, &p->qp_delta, &end) != 12)
+        return "expected <lo> - <hi> <gi> <mcs> <fecK> <fecN> <bitrate> <gop> <Pwr> <roiQP> <bandwidth> <qpDelta>";
+    if (line[end] != '\0') return "trailing text";
+    if (p->lo > p->hi) return "range is reversed";
+    if (strcmp(gi, "long") != 0 && strcmp(gi, "short") != 0) return "gi must be long or short";
+    p->short_gi = gi[0] == 's';
+    if (p->mcs < 0 || p->mcs > 31) return "mcs out of range";
+    if (p->fec_k < 1 || p->fec_n < p->fec_k || p->fec_n > 255) return "need 1 <= fecK <= fecN <= 255";
+    if (p->bitrate <= 0 || p->gop <= 0) return "bitrate and gop must be positive";
+    if (p->power < 0) return "Pwr must be >= 0";
+    if (!valid_roi(p->roi_qp)) return "roiQP must be four comma-separated numbers";
+    if (p->bandwidth != 10 && p->bandwidth != 20 && p->bandwidth != 40 && p->bandwidth != 80)
+        return "bandwidth must be 10, 20, 40 or 80";
+    return NULL;
+}
+
+static unsigned profile_diff(const tx_profile_t *a, const tx_profile_t *b) {
+    unsigned m = 0;
+    if (a->short_gi != b->short_gi) m |= TXP_GI;
+    if (a->mcs != b->mcs) m |= TXP_MCS;
+    if (a->bandwidth != b->bandwidth) m |= TXP_BANDWIDTH;
+    if (a->fec_k != b->fec_k || a->fec_n != b->fec_n) m |= TXP_FEC;
+    if (a->bitrate != b->bitrate) m |= TXP_BITRATE;
+    if (a->gop != b->gop) m |= TXP_GOP;
+    if (a->power != b->power) m |= TXP_POWER;
+    if (strcmp(a->roi_qp, b->roi_qp) != 0) m |= TXP_ROI;
+    if (a->qp_delta != b->qp_delta) m |= TXP_QP_DELTA;
+    return m;
+}
+
+int txprofiles_load(txprofile_table_t *t, const char *file, char *err, size_t err_size) {
+    txprofile_table_t nt;
+    memset(&nt, 0, sizeof(nt));
+    nt.file = file ? file : TXPROFILES_CONF;
+    file_mtime(nt.file, &nt.mtime);
+
+    FILE *f = fopen(nt.file, "r");
+    if (!f) {
+        snprintf(err, err_size, "cannot open %s", nt.file);
+        return -1;
+    }
+    char line[256];
+    const char *why = NULL;
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        line[strcspn(line, "\r\n")] = '\0';
+        const char *s = line + strspn(line, " \t");
+        if (*s == '\0' || *s == '#') continue;
+        if (nt.n == TXP_MAX) {
+            why = "too many profiles";
+            break;
+        }
+        tx_profile_t *p = &nt.p[nt.n];
+        why = parse_line(s, p);
+        if (!why && nt.n && p->lo <= nt.p[nt.n - 1].hi) why = "range overlaps or is out of order";
+        if (why) break;
+        nt.n++;
+    }
+    fclose(f);
+    if (why) {
+        snprintf(err, err_size, "%s:%d: %s", nt.file, lineno, why);
+        return -1;
+    }
+    if (!nt.n) {
+        snprintf(err, err_size, "%s: no profiles", nt.file);
+        return -1;
+    }
+
+    for (int i = 0; i + 1 < nt.n; i++) nt.step[i] = profile_diff(&nt.p[i], &nt.p[i + 1]);
+    *t = nt;
+    return 0;
+}
+
+int txprofiles_refresh(txprofile_table_t *t, char *err, size_t err_size) {
+    struct timespec ts;
+    if (t->n) {
+        file_mtime(t->file, &ts);
+        if (ts.tv_sec == t->mtime.tv_sec && ts.tv_nsec == t->mtime.tv_nsec) return 0;
+    }
+    if (txprofiles_load(t, t->file, err, err_size) == 0) return 1;
+    if (t->n) {
+        // Keep using the old table, and don't complain again until the
+        // file changes once more.
+        fprintf(stderr, "[WARN] %s; keeping the previous profiles\n", err);
+        file_mtime(t->file, &t->mtime);
+        return 0;
+    }
+    return -1;
+}
+
+int txprofiles_find(const txprofile_table_t *t, int score) {
+    if (!t->n) return -1;
+    int lo = 0, hi = t->n;             // first row with lo > score
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (t->p[mid].lo > score) hi = mid;
+        else lo = mid + 1;
+    }
+    return lo ? lo - 1 : 0;
+}
+
+unsigned txprofiles_diff(const txprofile_table_t *t, int from, int to) {
+    if (from < 0 || from >= t->n) return TXP_ALL;
+    if (from == to) return 0;
+    if (to == from + 1) return t->step[from];
+    if (to == from - 1) return t->step[to];
+    return profile_diff(&t->p[from], &t->p[to]);
+}
+
+void txprofiles_mask_str(unsigned mask, char *buf, size_t size) {
+    size_t n = 0;
+    buf[0] = '\0';
+    for (size_t i = 0; i < sizeof(txp_names) / sizeof(txp_names[0]) && n < size; i++)
+        if (mask & (1u << i))
+            n += snprintf(buf + n, size - n, "%s%s", n ? " " : "", txp_names[i]);
+}
@@ -0,0 +1,76 @@
+/*
+ * txprofiles.h - compiled /etc/txprofiles.conf
+ *
+ * Each line of txprofiles.conf maps a range of alink's link score to a full
+ * set of link parameters:
+ *   <lo> - <hi> <gi> <mcs> <fecK> <fecN> <bitrate> <gop> <Pwr> <roiQP> <bandwidth> <qpDelta>
+ * The table is checked once at load (ranges ascending and disjoint, values
+ * in range), looked up by binary search, and keeps for each pair of
+ * neighbouring rows the set of parameters that differ, so stepping one
+ * profile up or down only touches what changes.
+ * A table is plain data: callers that share one between threads lock it.
+ */
+#ifndef TXPROFILES_H
+#define TXPROFILES_H
+
+#include <stddef.h>
+#include <time.h>
+
+#include "sysroot.h"
+
+#define TXPROFILES_CONF AIR_MAN_SYSROOT "/etc/txprofiles.conf"
+#define TXP_MAX 32
+
+// Parameters of a profile, as a bit set.
+enum {
+    TXP_GI        = 1 << 0,
+    TXP_MCS       = 1 << 1,
+    TXP_BANDWIDTH = 1 << 2,
+    TXP_FEC       = 1 << 3,     // k and n together
+    TXP_BITRATE   = 1 << 4,
+    TXP_GOP       = 1 << 5,
+    TXP_POWER     = 1 << 6,
+    TXP_ROI       = 1 << 7,
+    TXP_QP_DELTA  = 1 << 8,
+    TXP_ALL       = (1 << 9) - 1
+};
+
+typedef struct {
+    int lo, hi;                 // link score range, inclusive
+    int short_gi;
+    int mcs;
+    int fec_k, fec_n;
+    int bitrate;                // kbit/s
+    int gop;
+    int power;                  // alink's Pwr; x50 (x-100 on rtl88XXau) gives mBm
+    char roi_qp[32];            // "a,b,c,d"
+    int bandwidth;              // MHz
+    int qp_delta;
+} tx_profile_t;
+
+typedef struct {
+    tx_profile_t p[TXP_MAX];    // ascending, disjoint ranges
+    int n;
+    unsigned step[TXP_MAX];     // TXP_* bits that differ between p[i] and p[i + 1]
+    const char *file;
+    struct timespec mtime;      // of file at load
+} txprofile_table_t;
+
+// Load and check file (NULL = TXPROFILES_CONF). On error *t is left as it
+// was, err says which line is wrong, and -1 is returned.
+int txprofiles_load(txprofile_table_t *t, const char *file, char *err, size_t err_size);
+// Reload if the file changed since the last load. Returns 1 if it was
+// reloaded, 0 if not (an invalid new file keeps the old table), -1 if there
+// is no usable table.
+int txprofiles_refresh(txprofile_table_t *t, char *err, size_t err_size);
+
+// Row for score: the last one whose range starts at or below it, so scores
+// in a gap or above the table use the row below; scores under the first
+// range use row 0. -1 only for an empty table.
+int txprofiles_find(const txprofile_table_t *t, int score);
+// TXP_* bits to issue when moving from row from (-1 = unknown) to row to.
+unsigned txprofiles_diff(const txprofile_table_t *t, int from, int to);
+// Names of the TXP_* bits in mask, space separated.
+void txprofiles_mask_str(unsigned mask, char *buf, size_t size);
+
+#endif /* TXPROFILES_H */
@@ -0,0 +1,236 @@
+/*
+ * wfb_tx_client.c - wfb_tx control port over one persistent UDP socket
+ *
+ * The socket is connected to 127.0.0.1:<port>, so only wfb_tx's replies
+ * arrive on it. One request is in flight at a time (a mutex serialises
+ * callers); late replies to a timed-out request are skipped by req_id. The
+ * last radio and FEC settings seen are cached for WFB_TX_CACHE_MS, which
+ * also lets set_mcs change one field without a get_radio round trip.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "wfb_tx_client.h"
+
+struct __attribute__((packed)) wfb_req {
+    uint32_t req_id;
+    uint8_t cmd;
+    union {
+        struct wfb_fec_wire fec;
+        struct wfb_radio_wire radio;
+    } u;
+};
+
+struct __attribute__((packed)) wfb_resp {
+    uint32_t req_id;
+    uint32_t rc;
+    union {
+        struct wfb_fec_wire fec;
+        struct wfb_radio_wire radio;
+    } u;
+};
+
+#define REQ_SIZE(field) (offsetof(struct wfb_req, u) + sizeof(((struct wfb_req *)0)->u.field))
+#define RESP_HDR_SIZE offsetof(struct wfb_resp, u)
+
+static struct {
+    pthread_mutex_t lock;
+    int port;
+    int fd;
+    uint32_t next_id;
+    wfb_radio_t radio;
+    long long radio_at;         // monotonic ms when radio was last known, 0 = never
+    int fec_k, fec_n;
+    long long fec_at;
+} wc = { .lock = PTHREAD_MUTEX_INITIALIZER, .port = WFB_TX_DEFAULT_PORT, .fd = -1, .next_id = 1 };
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static int fresh(long long at) {
+    return at && now_ms() - at < WFB_TX_CACHE_MS;
+}
+
+static int wfb_connect(void) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(wc.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Send req (size bytes) and wait for its reply. Caller holds wc.lock.
+// Returns wfb_tx's rc, or -1 if it did not answer in time.
+static int round_trip(struct wfb_req *req, size_t size, struct wfb_resp *resp, size_t resp_size) {
+    if (wc.fd < 0 && (wc.fd = wfb_connect()) < 0) return -1;
+    uint32_t id = wc.next_id++;
+    req->req_id = htonl(id);
+    if (send(wc.fd, req, size, MSG_NOSIGNAL) != (ssize_t)size) {
+        // ECONNREFUSED from an earlier datagram: nobody on the port.
+        return -1;
+    }
+
+    long long deadline = now_ms() + WFB_TX_TIMEOUT_MS;
+    for (;;) {
+        long long left = deadline - now_ms();
+        if (left <= 0) return -1;
+        struct pollfd pfd = { wc.fd, POLLIN, 0 };
+        int n = poll(&pfd, 1, left);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        ssize_t got = recv(wc.fd, resp, resp_size, 0);
+        if (got < 0) {
+            if (errno == EINTR || errno == EAGAIN) continue;
+            return -1;
+        }
+        if ((size_t)got < RESP_HDR_SIZE || ntohl(resp->req_id) != id) continue;   // stale
+        int rc = ntohl(resp->rc);
+        if (rc == 0 && (size_t)got < resp_size) return -1;    // short GET reply
+        return rc;
+    }
+}
+
+static void radio_to_wire(const wfb_radio_t *r, struct wfb_radio_wire *w) {
+    w->stbc = r->stbc;
+    w->ldpc = r->ldpc;
+    w->short_gi = r->short_gi;
+    w->bandwidth = r->bandwidth;
+    w->mcs_index = r->mcs_index;
+    w->vht_mode = r->vht_mode;
+    w->vht_nss = r->vht_nss;
+}
+
+static void radio_from_wire(const struct wfb_radio_wire *w, wfb_radio_t *r) {
+    r->stbc = w->stbc;
+    r->ldpc = w->ldpc;
+    r->short_gi = w->short_gi;
+    r->bandwidth = w->bandwidth;
+    r->mcs_index = w->mcs_index;
+    r->vht_mode = w->vht_mode;
+    r->vht_nss = w->vht_nss;
+}
+
+void wfb_tx_set_port(int port) {
+    pthread_mutex_lock(&wc.lock);
+    if (wc.fd >= 0) close(wc.fd);
+    wc.fd = -1;
+    wc.port = port;
+    wc.radio_at = wc.fec_at = 0;
+    pthread_mutex_unlock(&wc.lock);
+}
+
+// Caller holds wc.lock.
+static int get_radio_locked(wfb_radio_t *r) {
+    if (!fresh(wc.radio_at)) {
+        struct wfb_req req = { .cmd = WFB_CMD_GET_RADIO };
+        struct wfb_resp resp;
+        int rc = round_trip(&req, offsetof(struct wfb_req, u), &resp,
+                            RESP_HDR_SIZE + sizeof(resp.u.radio));
+        if (rc != 0) return rc;
+        radio_from_wire(&resp.u.radio, &wc.radio);
+        wc.radio_at = now_ms();
+    }
+    *r = wc.radio;
+    return 0;
+}
+
+// Caller holds wc.lock.
+static int set_radio_locked(const wfb_radio_t *r) {
+    struct wfb_req req = { .cmd = WFB_CMD_SET_RADIO };
+    struct wfb_resp resp;
+    radio_to_wire(r, &req.u.radio);
+    int rc = round_trip(&req, REQ_SIZE(radio), &resp, RESP_HDR_SIZE);
+    if (rc == 0) {
+        wc.radio = *r;
+        wc.radio_at = now_ms();
+    } else {
+        wc.radio_at = 0;        // unknown what wfb_tx is using now
+    }
+    return rc;
+}
+
+int wfb_tx_get_radio(wfb_radio_t *r) {
+    pthread_mutex_lock(&wc.lock);
+    int rc = get_radio_locked(r);
+    pthread_mutex_unlock(&wc.lock);
+    return rc;
+}
+
+int wfb_tx_set_radio(const wfb_radio_t *r) {
+    pthread_mutex_lock(&wc.lock);
+    int rc = set_radio_locked(r);
+    pthread_mutex_unlock(&wc.lock);
+    return rc;
+}
+
+int wfb_tx_set_mcs(int mcs) {
+    wfb_radio_t r;
+    pthread_mutex_lock(&wc.lock);
+    int rc = get_radio_locked(&r);
+    if (rc == 0) {
+        r.mcs_index = mcs;
+        rc = set_radio_locked(&r);
+    }
+    pthread_mutex_unlock(&wc.lock);
+    return rc;
+}
+
+int wfb_tx_get_fec(int *k, int *n) {
+    int rc = 0;
+    pthread_mutex_lock(&wc.lock);
+    if (!fresh(wc.fec_at)) {
+        struct wfb_req req = { .cmd = WFB_CMD_GET_FEC };
+        struct wfb_resp resp;
+        rc = round_trip(&req, offsetof(struct wfb_req, u), &resp, RESP_HDR_SIZE + sizeof(resp.u.fec));
+        if (rc == 0) {
+            wc.fec_k = resp.u.fec.k;
+            wc.fec_n = resp.u.fec.n;
+            wc.fec_at = now_ms();
+        }
+    }
+    if (rc == 0) {
+        *k = wc.fec_k;
+        *n = wc.fec_n;
+    }
+    pthread_mutex_unlock(&wc.lock);
+    return rc;
+}
+
+int wfb_tx_set_fec(int k, int n) {
+    struct wfb_req req = { .cmd = WFB_CMD_SET_FEC };
+    struct wfb_resp resp;
+    req.u.fec.k = k;
+    req.u.fec.n = n;
+    pthread_mutex_lock(&wc.lock);
+    int rc = round_trip(&req, REQ_SIZE(fec), &resp, RESP_HDR_SIZE);
+    if (rc == 0) {
+        wc.fec_k = k;
+        wc.fec_n = n;
+        wc.fec_at = now_ms();
+    } else {
+        wc.fec_at = 0;
+    }
+    pthread_mutex_unlock(&wc.lock);
+    return rc;
+}
@@ -0,0 +1,62 @@
+/*
+ * wfb_tx_client.h - client for wfb_tx's UDP control port
+ *
+ * Speaks the protocol of "wfb_tx_cmd <port> ..." (wfb-ng tx_cmd.h) without
+ * forking it. Requests and replies are packed structs; req_id and rc are in
+ * network byte order, rc is 0 or an errno from wfb_tx.
+ *   request: { uint32 req_id, uint8 cmd } + command payload
+ *   reply:   { uint32 req_id, uint32 rc } + GET_* payload
+ * wfb_tx listens on 127.0.0.1; the port is its "-C" option (8000 on OpenIPC).
+ */
+#ifndef WFB_TX_CLIENT_H
+#define WFB_TX_CLIENT_H
+
+#include <stdint.h>
+
+enum {
+    WFB_CMD_SET_FEC   = 1,      // k, n
+    WFB_CMD_SET_RADIO = 2,      // struct wfb_radio_wire
+    WFB_CMD_GET_FEC   = 3,
+    WFB_CMD_GET_RADIO = 4
+};
+
+struct __attribute__((packed)) wfb_fec_wire {
+    uint8_t k, n;
+};
+
+struct __attribute__((packed)) wfb_radio_wire {
+    uint8_t stbc;
+    uint8_t ldpc;
+    uint8_t short_gi;
+    uint8_t bandwidth;
+    uint8_t mcs_index;
+    uint8_t vht_mode;
+    uint8_t vht_nss;
+};
+
+#define WFB_TX_DEFAULT_PORT 8000
+#define WFB_TX_TIMEOUT_MS 1000
+// How long a reply or a successful set is trusted before asking wfb_tx
+// again. alink changes the radio through its own wfb_tx_cmd, so keep short.
+#define WFB_TX_CACHE_MS 1000
+
+typedef struct {
+    int stbc, ldpc, short_gi;
+    int bandwidth;              // MHz
+    int mcs_index;
+    int vht_mode, vht_nss;
+} wfb_radio_t;
+
+// Use port from now on (drops the socket and the cache).
+void wfb_tx_set_port(int port);
+
+// Return 0 on success, the errno wfb_tx replied with, or -1 if it did not
+// answer. The getters may answer from the cache.
+int wfb_tx_get_radio(wfb_radio_t *r);
+int wfb_tx_set_radio(const wfb_radio_t *r);
+int wfb_tx_get_fec(int *k, int *n);
+int wfb_tx_set_fec(int k, int n);
+// Change only the MCS, keeping the rest of the radio settings.
+int wfb_tx_set_mcs(int mcs);
+
+#endif /* WFB_TX_CLIENT_H */
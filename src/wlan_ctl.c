@@ -0,0 +1,208 @@
+/*
+ * wlan_ctl.c - minimal nl80211 client (no libnl)
+ *
+ * Builds NL80211_CMD_SET_WIPHY requests by hand on a generic netlink socket
+ * that stays open for the life of the process. The nl80211 family id is
+ * resolved once; if the socket breaks it is reopened on the next call.
+ * Attribute layout follows what "iw dev <if> set channel|txpower" sends.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <linux/nl80211.h>
+
+#include "wlan_ctl.h"
+
+#define NL_BUF_SIZE 4096
+#define NL_TIMEOUT_MS 1000
+
+static struct {
+    pthread_mutex_t lock;
+    int fd;
+    uint16_t family;     // nl80211 generic netlink family id, 0 = unresolved
+    uint32_t seq;
+} nl = { PTHREAD_MUTEX_INITIALIZER, -1, 0, 0 };
+
+typedef struct {
+    union {
+        struct nlmsghdr hdr;
+        char buf[512];
+    };
+} nl_req_t;
+
+static void nl_init(nl_req_t *req, uint16_t type, uint8_t cmd) {
+    memset(req, 0, sizeof(*req));
+    req->hdr.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+    req->hdr.nlmsg_type = type;
+    req->hdr.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+    req->hdr.nlmsg_seq = ++nl.seq;
+    struct genlmsghdr *g = NLMSG_DATA(&req->hdr);
+    g->cmd = cmd;
+    g->version = 1;
+}
+
+static void nl_put(nl_req_t *req, uint16_t type, const void *data, size_t len) {
+    struct nlattr *a = (struct nlattr *)(req->buf + NLMSG_ALIGN(req->hdr.nlmsg_len));
+    a->nla_type = type;
+    a->nla_len = NLA_HDRLEN + len;
+    memcpy((char *)a + NLA_HDRLEN, data, len);
+    req->hdr.nlmsg_len = NLMSG_ALIGN(req->hdr.nlmsg_len) + NLA_ALIGN(a->nla_len);
+}
+
+static void nl_put_u32(nl_req_t *req, uint16_t type, uint32_t v) {
+    nl_put(req, type, &v, sizeof(v));
+}
+
+static void nl_close(void) {
+    if (nl.fd >= 0) close(nl.fd);
+    nl.fd = -1;
+    nl.family = 0;
+}
+
+// Send req and wait for its ACK. For CTRL_CMD_GETFAMILY the reply message
+// is scanned for the family id. Returns 0 or -errno.
+static int nl_transact(nl_req_t *req) {
+    if (send(nl.fd, req, req->hdr.nlmsg_len, 0) < 0) return -errno;
+
+    char buf[NL_BUF_SIZE];
+    for (;;) {
+        ssize_t n = recv(nl.fd, buf, sizeof(buf), 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN ? -ETIMEDOUT : -errno;
+        }
+        for (struct nlmsghdr *h = (struct nlmsghdr *)buf; NLMSG_OK(h, (size_t)n); h = NLMSG_NEXT(h, n)) {
+            if (h->nlmsg_seq != req->hdr.nlmsg_seq) continue;
+            if (h->nlmsg_type == NLMSG_ERROR) {
+                struct nlmsgerr *e = NLMSG_DATA(h);
+                return e->error;     // 0 is the ACK
+            }
+            if (h->nlmsg_type == GENL_ID_CTRL) {
+                struct nlattr *a = (struct nlattr *)((char *)NLMSG_DATA(h) + GENL_HDRLEN);
+                int left = h->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+                while (left >= NLA_HDRLEN && a->nla_len >= NLA_HDRLEN && a->nla_len <= left) {
+                    if ((a->nla_type & NLA_TYPE_MASK) == CTRL_ATTR_FAMILY_ID)
+                        nl.family = *(uint16_t *)((char *)a + NLA_HDRLEN);
+                    left -= NLA_ALIGN(a->nla_len);
+                    a = (struct nlattr *)((char *)a + NLA_ALIGN(a->nla_len));
+                }
+            }
+        }
+    }
+}
+
+// Open the socket and resolve the nl80211 family if needed. Caller holds nl.lock.
+static int nl_ensure(void) {
+    if (nl.fd >= 0 && nl.family) return 0;
+    nl_close();
+    nl.fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+    if (nl.fd < 0) return -errno;
+    struct timeval tv = { NL_TIMEOUT_MS / 1000, (NL_TIMEOUT_MS % 1000) * 1000 };
+    setsockopt(nl.fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    struct sockaddr_nl local = { .nl_family = AF_NETLINK };
+    if (bind(nl.fd, (struct sockaddr *)&local, sizeof(local)) < 0) {
+        int err = -errno;
+        nl_close();
+        return err;
+    }
+
+    nl_req_t req;
+    nl_init(&req, GENL_ID_CTRL, CTRL_CMD_GETFAMILY);
+    nl_put(&req, CTRL_ATTR_FAMILY_NAME, NL80211_GENL_NAME, sizeof(NL80211_GENL_NAME));
+    int rc = nl_transact(&req);
+    if (rc == 0 && !nl.family) rc = -ENOENT;
+    if (rc < 0) nl_close();
+    return rc;
+}
+
+// Run one SET_WIPHY request built by fill(); retried once on a fresh socket
+// if the old one went bad.
+static int nl_set_wiphy(const char *ifname, void (*fill)(nl_req_t *, const int *), const int *args) {
+    unsigned ifindex = if_nametoindex(ifname);
+    if (!ifindex) return -ENODEV;
+
+    pthread_mutex_lock(&nl.lock);
+    int rc = 0;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        rc = nl_ensure();
+        if (rc < 0) break;
+        nl_req_t req;
+        nl_init(&req, nl.family, NL80211_CMD_SET_WIPHY);
+        nl_put_u32(&req, NL80211_ATTR_IFINDEX, ifindex);
+        fill(&req, args);
+        rc = nl_transact(&req);
+        if (rc != -EBADF && rc != -ENOTCONN && rc != -ETIMEDOUT) break;
+        nl_close();
+    }
+    pthread_mutex_unlock(&nl.lock);
+    return rc;
+}
+
+int wlan_channel_to_freq(int channel) {
+    if (channel == 14) return 2484;
+    if (channel >= 1 && channel <= 13) return 2407 + channel * 5;
+    if (channel >= 32 && channel <= 196) return 5000 + channel * 5;
+    return 0;
+}
+
+// Centre of the 80 MHz block containing freq (same table as iw).
+static int center_80(int freq) {
+    static const int starts[] = { 5180, 5260, 5500, 5580, 5660, 5745, 5825 };
+    for (size_t i = 0; i < sizeof(starts) / sizeof(starts[0]); i++)
+        if (freq >= starts[i] && freq < starts[i] + 80) return starts[i] + 30;
+    return 0;
+}
+
+// args: { freq, width_mhz }
+static void fill_channel(nl_req_t *req, const int *args) {
+    int freq = args[0];
+    nl_put_u32(req, NL80211_ATTR_WIPHY_FREQ, freq);
+    switch (args[1]) {
+    case 10:
+        nl_put_u32(req, NL80211_ATTR_CHANNEL_WIDTH, NL80211_CHAN_WIDTH_10);
+        nl_put_u32(req, NL80211_ATTR_CENTER_FREQ1, freq);
+        break;
+    case 40:
+        nl_put_u32(req, NL80211_ATTR_CHANNEL_WIDTH, NL80211_CHAN_WIDTH_40);
+        nl_put_u32(req, NL80211_ATTR_WIPHY_CHANNEL_TYPE, NL80211_CHAN_HT40PLUS);
+        nl_put_u32(req, NL80211_ATTR_CENTER_FREQ1, freq + 10);
+        break;
+    case 80:
+        nl_put_u32(req, NL80211_ATTR_CHANNEL_WIDTH, NL80211_CHAN_WIDTH_80);
+        nl_put_u32(req, NL80211_ATTR_CENTER_FREQ1, center_80(freq));
+        break;
+    default:
+        nl_put_u32(req, NL80211_ATTR_CHANNEL_WIDTH, NL80211_CHAN_WIDTH_20_NOHT);
+        nl_put_u32(req, NL80211_ATTR_WIPHY_CHANNEL_TYPE, NL80211_CHAN_NO_HT);
+        break;
+    }
+}
+
+int wlan_set_channel(const char *ifname, int channel, int width_mhz) {
+    int freq = wlan_channel_to_freq(channel);
+    if (!freq) return -EINVAL;
+    if (width_mhz == 80 && !center_80(freq)) return -EINVAL;
+    int args[2] = { freq, width_mhz };
+    return nl_set_wiphy(ifname, fill_channel, args);
+}
+
+// args: { mbm }
+static void fill_txpower(nl_req_t *req, const int *args) {
+    nl_put_u32(req, NL80211_ATTR_WIPHY_TX_POWER_SETTING, NL80211_TX_POWER_FIXED);
+    nl_put_u32(req, NL80211_ATTR_WIPHY_TX_POWER_LEVEL, (uint32_t)args[0]);
+}
+
+int wlan_set_txpower(const char *ifname, int mbm) {
+    return nl_set_wiphy(ifname, fill_txpower, &mbm);
+}
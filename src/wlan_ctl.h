@@ -0,0 +1,24 @@
+/*
+ * wlan_ctl.h - set channel, width and TX power through nl80211
+ *
+ * air_man keeps one generic netlink socket open instead of running
+ * "iw dev wlan0 set ..." for every change. All calls are thread-safe and
+ * return 0 on success or a negative errno (e.g. -EBUSY, -EINVAL from the
+ * driver, -ENODEV for an unknown interface).
+ */
+#ifndef WLAN_CTL_H
+#define WLAN_CTL_H
+
+#define WLAN_IFNAME "wlan0"
+
+// Tune ifname to channel. width_mhz is 10, 20, 40 (HT40+) or 80; 20 leaves
+// the channel type to the driver like plain "iw set channel <n>".
+int wlan_set_channel(const char *ifname, int channel, int width_mhz);
+
+// Fixed TX power in mBm (100 mBm = 1 dBm), as "iw set txpower fixed".
+int wlan_set_txpower(const char *ifname, int mbm);
+
+// Channel number to centre frequency in MHz, or 0 if unknown.
+int wlan_channel_to_freq(int channel);
+
+#endif /* WLAN_CTL_H */
@@ -0,0 +1,279 @@
+/*
+ * yaml-cli - command-line front end for stupid-yaml.c
+ *
+ * Compile with:
+ *     gcc -pthread -o yaml-cli yaml-cli.c stupid-yaml.c
+ *
+ * Command-line arguments:
+ *    -i <file>          Specify the YAML file to parse.
+ *    -g <key>           Get the value at the dot-separated key path.
+ *                       If the node is a container, its entire inline
+ *                       representation is printed (e.g. [1,2,3]).
+ *    -s <key> <value>   Set value at the dot-separated key path using inline style for lists.
+ *                       (e.g. -s list.key "[1,2,3]" saves the list inline)
+ *    -S <key> <value>   Set value at the dot-separated key path using dash notation for lists.
+ *    -d <key>           Delete the node at the dot-separated key path.
+ *
+ *    -b                 Batch: read operations from stdin, one per line:
+ *                         get <key> | set <key> <value> | SET <key> <value> | del <key>
+ *                       Blank lines and lines starting with '#' are ignored.
+ *
+ * When using -s/-S and -d, changes are saved back to the file. The file is
+ * replaced atomically (temp file + rename), left alone if nothing changed,
+ * and /tmp/<name>.lock is flock'ed from load to save.
+ * Leading dots (e.g. ".fpv.enabled") are allowed.
+ *
+ * -g/-s/-S/-d may be repeated and combined with -b. With more than one
+ * operation the file is parsed once, operations run in the order given,
+ * every get prints "<key>=<value>" (empty value if the key is missing) and
+ * the file is written once at the end if anything changed.
+ *
+ * If no operation (-g, -s, -S or -d) is specified, a sanity check is performed:
+ * the YAML file is parsed and the complete structure is dumped in a pretty format.
+ *
+ * Example usage:
+ *    ./yaml-cli -i config.yaml
+ *    ./yaml-cli -i config.yaml -g network.wifi.ssid
+ *    ./yaml-cli -i config.yaml -s credentials.password newsecret
+ *    ./yaml-cli -i config.yaml -S list.key "[1,2,3,4]"   (dash notation for lists)
+ *    ./yaml-cli -i config.yaml -d network.ethernet
+ *    ./yaml-cli -i wfb.yaml -g .wireless.width -g .wireless.channel -s .broadcast.fec_k 8
+ *    printf 'get .wireless.width\nset .broadcast.fec_n 12\n' | ./yaml-cli -i wfb.yaml -b
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <getopt.h>      /* added for getopt_long() */
+
+#include "stupid-yaml.h"
+
+static void handle_signal(int sig) {
+    fprintf(stderr, "\nReceived signal %d, exiting gracefully...\n", sig);
+    exit(EXIT_FAILURE);
+}
+
+typedef enum { OP_GET, OP_SET, OP_SET_DASH, OP_DELETE } OpType;
+
+typedef struct {
+    OpType type;
+    char *path;
+    char *value;
+} Op;
+
+static Op *ops;
+static size_t num_ops, cap_ops;
+
+static void add_op(OpType type, const char *path, const char *value) {
+    if (num_ops == cap_ops) {
+        cap_ops = cap_ops ? cap_ops * 2 : 8;
+        ops = realloc(ops, cap_ops * sizeof(Op));
+        if (!ops) { perror("realloc"); exit(EXIT_FAILURE); }
+    }
+    ops[num_ops].type = type;
+    ops[num_ops].path = strdup(path);
+    ops[num_ops].value = value ? strdup(value) : NULL;
+    num_ops++;
+}
+
+/* Read "get/set/SET/del" lines from f. Returns 0, or -1 on a bad line. */
+static int read_batch(FILE *f) {
+    char line[1024];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), f)) {
+        line_number++;
+        line[strcspn(line, "\r\n")] = '\0';
+        char *p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '\0' || *p == '#') continue;
+
+        char *verb = p;
+        p += strcspn(p, " \t");
+        if (*p) *p++ = '\0';
+        while (*p == ' ' || *p == '\t') p++;
+        char *key = p;
+        p += strcspn(p, " \t");
+        if (*p) *p++ = '\0';
+        while (*p == ' ' || *p == '\t') p++;
+        char *value = p;
+        /* strip one pair of surrounding quotes */
+        size_t vlen = strlen(value);
+        if (vlen >= 2 && (value[0] == '"' || value[0] == '\'') && value[vlen - 1] == value[0]) {
+            value[vlen - 1] = '\0';
+            value++;
+        }
+
+        if (!*key) {
+            fprintf(stderr, "Error at batch line %d: missing key\n", line_number);
+            return -1;
+        }
+        if (strcmp(verb, "get") == 0) add_op(OP_GET, key, NULL);
+        else if (strcmp(verb, "set") == 0) add_op(OP_SET, key, value);
+        else if (strcmp(verb, "SET") == 0) add_op(OP_SET_DASH, key, value);
+        else if (strcmp(verb, "del") == 0 || strcmp(verb, "delete") == 0) add_op(OP_DELETE, key, NULL);
+        else {
+            fprintf(stderr, "Error at batch line %d: unknown operation '%s'\n", line_number, verb);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Apply every queued operation to root; print gets as key=value.
+   Returns nonzero if the tree was modified. */
+static int run_batch(YAMLNode *root) {
+    int modified = 0;
+    char buf[4096];
+    for (size_t i = 0; i < num_ops; i++) {
+        Op *op = &ops[i];
+        switch (op->type) {
+            case OP_GET:
+                if (yaml_get_value(root, op->path, buf, sizeof(buf)) != 0) buf[0] = '\0';
+                printf("%s=%s\n", op->path, buf);
+                break;
+            case OP_SET:
+            case OP_SET_DASH:
+                if (yaml_set_value(root, op->path, op->value, op->type == OP_SET_DASH) == 0)
+                    modified = 1;
+                else
+                    fprintf(stderr, "Could not set value at '%s'.\n", op->path);
+                break;
+            case OP_DELETE:
+                if (delete_node_at_path(root, op->path))
+                    modified = 1;
+                break;
+        }
+    }
+    fflush(stdout);
+    return modified;
+}
+
+static void usage(const char *progname) {
+    fprintf(stderr, "Usage: %s -i <file> [ -g <key> | -s <key> <value> | -S <key> <value> | -d <key> | -b ]...\n", progname);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -i <file>          YAML file to parse\n");
+    fprintf(stderr, "  -g <key>           Get value at the dot-separated key path (outputs inline representation)\n");
+    fprintf(stderr, "  -s <key> <value>   Set value at the dot-separated key path using inline style for lists\n");
+    fprintf(stderr, "                     (e.g. -s list.key \"[1,2,3]\" saves the list inline)\n");
+    fprintf(stderr, "  -S <key> <value>   Set value at the dot-separated key path using dash notation for lists\n");
+    fprintf(stderr, "  -d <key>           Delete node at the dot-separated key path\n");
+    fprintf(stderr, "  -b                 Read get/set/SET/del operations from stdin\n");
+    fprintf(stderr, "Several operations may be given; they share one parse and one save,\n");
+    fprintf(stderr, "and gets are printed as <key>=<value>.\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 1) {
+        usage(argv[0]);
+    }
+    signal(SIGINT, handle_signal);
+    char *filename = NULL;
+    int batch_stdin = 0;
+    int opt;
+
+    /* long-option table (new) */
+    static struct option long_options[] = {
+        { "set",    required_argument, 0, 's' },
+        { "SET",    required_argument, 0, 'S' },
+        { "get",    required_argument, 0, 'g' },
+        { "delete", required_argument, 0, 'd' },
+        { "batch",  no_argument,       0, 'b' },
+        { 0, 0, 0, 0 }
+    };
+
+    while ((opt = getopt_long(argc, argv,
+                              "i:g:s:S:d:b",  /* short options */
+                              long_options,   /* long-option table */
+                              NULL)) != -1) {
+        switch (opt) {
+            case 'i':
+                filename = optarg;
+                break;
+            case 'g':
+                add_op(OP_GET, optarg, NULL);
+                break;
+            case 's':
+            case 'S':
+                if (optind < argc) {
+                    add_op(opt == 'S' ? OP_SET_DASH : OP_SET, optarg, argv[optind++]);
+                } else {
+                    fprintf(stderr, "Error: -%c requires a key and a value.\n", opt);
+                    usage(argv[0]);
+                }
+                break;
+            case 'd':
+                add_op(OP_DELETE, optarg, NULL);
+                break;
+            case 'b':
+                batch_stdin = 1;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (!filename) {
+        fprintf(stderr, "Error: No input file specified.\n");
+        usage(argv[0]);
+    }
+    if (batch_stdin && read_batch(stdin) < 0) exit(EXIT_FAILURE);
+
+    /* Hold the file's lock from load to save so concurrent writers
+       (air_man, datalink_manager.sh, alink) can't lose each other's edits.
+       It is released on exit. */
+    int writes = 0;
+    for (size_t i = 0; i < num_ops; i++)
+        if (ops[i].type != OP_GET) writes = 1;
+    int lock_fd = yaml_lock(filename, writes);
+
+    FILE *f = fopen(filename, "r");
+    if (!f) { perror("fopen"); exit(EXIT_FAILURE); }
+    YAMLNode *root = yaml_new_document();
+    if (parse_yaml(f, root) < 0) exit(EXIT_FAILURE);
+    fclose(f);
+
+    if (num_ops > 1 || batch_stdin) {
+        if (run_batch(root) && save_yaml(filename, root) < 0) exit(EXIT_FAILURE);
+    } else if (num_ops == 1 && ops[0].type == OP_GET) {
+        YAMLNode *node = find_node(root, ops[0].path);
+        if (node) {
+            if (node->type == YAML_NODE_SCALAR && node->value)
+                printf("%s\n", node->value);
+            else {
+                print_inline_yaml(stdout, node);
+                printf("\n");
+            }
+            fflush(stdout);
+        } else {
+            //Printout should be empty for WebUI compatibility.
+            //printf("Node not found.\n");
+        }
+    } else if (num_ops == 1 && (ops[0].type == OP_SET || ops[0].type == OP_SET_DASH)) {
+        if (yaml_set_value(root, ops[0].path, ops[0].value, ops[0].type == OP_SET_DASH) == 0) {
+            //printf("Value set at '%s'.\n", set_path);
+            if (save_yaml(filename, root) < 0) exit(EXIT_FAILURE);
+            //printf("Changes saved to file '%s'.\n", filename);
+        } else {
+            //printf("Could not set value at '%s'.\n", set_path);
+        }
+    } else if (num_ops == 1 && ops[0].type == OP_DELETE) {
+        const char *delete_path = ops[0].path;
+        int result = delete_node_at_path(root, delete_path);
+        if (result) {
+            printf("Node '%s' deleted.\n", delete_path);
+            if (save_yaml(filename, root) < 0) exit(EXIT_FAILURE);
+            printf("Changes saved to file '%s'.\n", filename);
+        } else {
+            printf("Node '%s' not found.\n", delete_path);
+        }
+    } else {
+        /* Sanity check: no operation specified, so dump the parsed structure */
+        printf("YAML configuration parsed successfully. Dumping structure:\n");
+        print_yaml(root, 0);
+    }
+    free_node(root);
+    yaml_unlock(lock_fd);
+    return EXIT_SUCCESS;
+}
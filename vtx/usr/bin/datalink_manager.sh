@@ -22,11 +22,43 @@ yaml_list() {
     | grep -v '^$'
 }
 
+# One yaml-cli pass over a file: operations on stdin (get/set/del, one per
+# line), gets come back as key=value. Parses and saves the file once.
+# A yaml-cli built before -b existed gets one -g/-s/-S/-d call per line.
+if yaml-cli 2>&1 | grep -q -- '| -b'; then
+  yaml_batch() { yaml-cli -i "$1" -b 2>/dev/null; }
+else
+  yaml_batch() {
+    rc=0
+    while read -r op key value; do
+      case "$op" in
+        get)        printf '%s=%s\n' "$key" "$(yaml-cli -i "$1" -g "$key" 2>/dev/null)" ;;
+        set)        yaml-cli -i "$1" -s "$key" "$value" >/dev/null 2>&1 || rc=1 ;;
+        SET)        yaml-cli -i "$1" -S "$key" "$value" >/dev/null 2>&1 || rc=1 ;;
+        del|delete) yaml-cli -i "$1" -d "$key" >/dev/null 2>&1 || rc=1 ;;
+      esac
+    done
+    return $rc
+  }
+fi
+# kv <batch output> <key>
+kv()   { printf '%s\n' "$1" | awk -v k="$2=" 'index($0, k) == 1 { print substr($0, length(k) + 1); exit }'; }
+kv_num()  { kv "$1" "$2" | grep -Eo '[0-9.]+' | head -n1; }
+kv_list() { kv "$1" "$2" | tr -d '[]' | tr ',' '\n' | tr -d ' ' | grep -v '^$'; }
+
 bw_group()  { printf "%smhz" "$1"; }
 
-raw_rate()  { yaml_num "$LINKMODES_CFG" ".link_modes.modes.$1.raw_rate_mbps"; }
+# mode_table <mode keys...>: raw rate and mlink for every key in one pass;
+# raw_rate/net30/mtu below read from its output in $MODES_KV
+mode_table() {
+  for key in "$@"; do
+    echo "get .link_modes.modes.$key.raw_rate_mbps"
+    echo "get .link_modes.modes.$key.mlink"
+  done | yaml_batch "$LINKMODES_CFG"
+}
+raw_rate()  { kv_num "$MODES_KV" ".link_modes.modes.$1.raw_rate_mbps"; }
 net30() { r=$(raw_rate "$1"); [ -z "$r" ] && echo 0 || printf "scale=4; $r*0.70\n" | bc -l; }
-mtu()  { yaml_num "$LINKMODES_CFG" ".link_modes.modes.$1.mlink"; }
+mtu()  { kv_num "$MODES_KV" ".link_modes.modes.$1.mlink"; }
 
 dbg() { [ "$VERBOSE" -eq 1 ] && echo "DEBUG: $*"; }
 
@@ -37,9 +69,16 @@ preset_val() {
 ###############################################################################
 list_modes() {
   adapter=$(yaml_str "$WFB_CFG" ".wireless.wlan_adapter") || exit 1
+  LM_KV=$(yaml_batch "$ADAPTER_CFG" <<EOF
+get .profiles.$adapter.link_modes.10mhz
+get .profiles.$adapter.link_modes.20mhz
+get .profiles.$adapter.link_modes.40mhz
+EOF
+)
+  MODES_KV=$(mode_table $(for bw in 10mhz 20mhz 40mhz; do kv_list "$LM_KV" ".profiles.$adapter.link_modes.$bw"; done))
   for bw in 10mhz 20mhz 40mhz; do
     echo "=== $bw ==="
-    for key in $(yaml_list "$ADAPTER_CFG" ".profiles.$adapter.link_modes.$bw"); do
+    for key in $(kv_list "$LM_KV" ".profiles.$adapter.link_modes.$bw"); do
       printf "  %-18s ~%6.1f Mbps  MTU:%4s\n" "$key" "$(net30 "$key")" "$(mtu "$key")"
     done
   done
@@ -47,13 +86,39 @@ list_modes() {
 
 ###############################################################################
 info_adapter() {
+  # ── live settings from wfb.yaml (wireless & broadcast sections) ────────────
+  WFB_KV=$(yaml_batch "$WFB_CFG" <<EOF
+get .wireless.wlan_adapter
+get .wireless.width
+get .wireless.channel
+get .wireless.txpower
+get .wireless.mlink
+get .wireless.link_control
+get .broadcast.fec_k
+get .broadcast.fec_n
+get .broadcast.stbc
+get .broadcast.ldpc
+EOF
+)
+
   # ── active adapter name ────────────────────────────────────────────────────
-  a=$(yaml_str "$WFB_CFG" ".wireless.wlan_adapter") || exit 1
+  a=$(kv "$WFB_KV" .wireless.wlan_adapter)
+  [ -z "$a" ] && exit 1
 
   # ── adapter capabilities (from wlan_adapters.yaml) ─────────────────────────
-  bw=$(yaml_list "$ADAPTER_CFG" ".profiles.$a.bw"       | paste -sd ',' -)
-  gi=$(yaml_list "$ADAPTER_CFG" ".profiles.$a.guard"    | paste -sd ',' -)
-  mcs_list=$(yaml_list "$ADAPTER_CFG" ".profiles.$a.mcs"| paste -sd ',' -)
+  AD_KV=$(yaml_batch "$ADAPTER_CFG" <<EOF
+get .profiles.$a.bw
+get .profiles.$a.guard
+get .profiles.$a.mcs
+get .profiles.$a.max_mtu
+get .profiles.$a.link_modes.10mhz
+get .profiles.$a.link_modes.20mhz
+get .profiles.$a.link_modes.40mhz
+EOF
+)
+  bw=$(kv_list "$AD_KV" ".profiles.$a.bw"       | paste -sd ',' -)
+  gi=$(kv_list "$AD_KV" ".profiles.$a.guard"    | paste -sd ',' -)
+  mcs_list=$(kv_list "$AD_KV" ".profiles.$a.mcs"| paste -sd ',' -)
   mcs_min=$(echo "$mcs_list" | cut -d',' -f1)
   mcs_max=$(echo "$mcs_list" | awk -F',' '{print $NF}')
   mcs_count=$(echo "$mcs_list" | tr ',' '\n' | wc -l)
@@ -62,23 +127,22 @@ info_adapter() {
   else
     mcs="$mcs_list"
   fi
-  mtu=$(yaml_num "$ADAPTER_CFG" ".profiles.$a.max_mtu")
-  lm10=$(yaml_list "$ADAPTER_CFG" ".profiles.$a.link_modes.10mhz" | paste -sd ',' -)
-  lm20=$(yaml_list "$ADAPTER_CFG" ".profiles.$a.link_modes.20mhz" | paste -sd ',' -)
-  lm40=$(yaml_list "$ADAPTER_CFG" ".profiles.$a.link_modes.40mhz" | paste -sd ',' -)
+  mtu=$(kv_num "$AD_KV" ".profiles.$a.max_mtu")
+  lm10=$(kv_list "$AD_KV" ".profiles.$a.link_modes.10mhz" | paste -sd ',' -)
+  lm20=$(kv_list "$AD_KV" ".profiles.$a.link_modes.20mhz" | paste -sd ',' -)
+  lm40=$(kv_list "$AD_KV" ".profiles.$a.link_modes.40mhz" | paste -sd ',' -)
 
   echo "adapter=$a;bw=$bw;guard=$gi;mcs=$mcs;max_mtu=$mtu;link_modes_10=$lm10;link_modes_20=$lm20;link_modes_40=$lm40"
 
-  # ── live settings from wfb.yaml (wireless & broadcast sections) ────────────
-  width=$(yaml_num "$WFB_CFG" ".wireless.width")
-  chan=$(yaml_num "$WFB_CFG" ".wireless.channel")
-  txp=$(yaml_num "$WFB_CFG" ".wireless.txpower")
-  mlink=$(yaml_num "$WFB_CFG" ".wireless.mlink")
-  lctl=$(yaml_str "$WFB_CFG" ".wireless.link_control")
-  fec_k=$(yaml_num "$WFB_CFG" ".broadcast.fec_k")
-  fec_n=$(yaml_num "$WFB_CFG" ".broadcast.fec_n")
-  stbc=$(yaml_num "$WFB_CFG" ".broadcast.stbc")
-  ldpc=$(yaml_num "$WFB_CFG" ".broadcast.ldpc")
+  width=$(kv_num "$WFB_KV" ".wireless.width")
+  chan=$(kv_num "$WFB_KV" ".wireless.channel")
+  txp=$(kv_num "$WFB_KV" ".wireless.txpower")
+  mlink=$(kv_num "$WFB_KV" ".wireless.mlink")
+  lctl=$(kv "$WFB_KV" ".wireless.link_control")
+  fec_k=$(kv_num "$WFB_KV" ".broadcast.fec_k")
+  fec_n=$(kv_num "$WFB_KV" ".broadcast.fec_n")
+  stbc=$(kv_num "$WFB_KV" ".broadcast.stbc")
+  ldpc=$(kv_num "$WFB_KV" ".broadcast.ldpc")
 
   echo "wfb=width=$width;channel=$chan;txpower=$txp;mlink=$mlink;link_control=$lctl;fec_k=$fec_k;fec_n=$fec_n;stbc=$stbc;ldpc=$ldpc"
 }
@@ -114,21 +178,13 @@ EOF
   gi_full=$( [ "$gi_tag" = "lgi" ] && echo long || echo short )
 
   # Current STBC / LDPC from wfb.yaml (0/1)
-  stbc=$(yaml_num "$WFB_CFG" ".broadcast.stbc"); [ -z "$stbc" ] && stbc=0
-  ldpc=$(yaml_num "$WFB_CFG" ".broadcast.ldpc"); [ -z "$ldpc" ] && ldpc=0
+  WFB_KV=$(printf 'get .broadcast.stbc\nget .broadcast.ldpc\n' | yaml_batch "$WFB_CFG")
+  stbc=$(kv_num "$WFB_KV" ".broadcast.stbc"); [ -z "$stbc" ] && stbc=0
+  ldpc=$(kv_num "$WFB_KV" ".broadcast.ldpc"); [ -z "$ldpc" ] && ldpc=0
 
   echo "Applying mode: $mode  (MCS=$mcs  BW=${bandwidth}MHz  GI=$gi_full  STBC=$stbc  LDPC=$ldpc)"
 
-  # ── 1) Update width in /etc/wfb.yaml ───────────────────────────────────────
-  yaml-cli -i "$WFB_CFG" -s .wireless.width "$bandwidth" >/dev/null \
-    && echo "Updated wfb.yaml width → $bandwidth MHz"
-
-  yaml-cli -i "$WFB_CFG" -s .broadcast.fec_k 8 >/dev/null \
-    && echo "Updated wfb.yaml fec_k → 8"
-  yaml-cli -i "$WFB_CFG" -s .broadcast.fec_n 12 >/dev/null \
-    && echo "Updated wfb.yaml fec_n → 12"
-
-  # ── 2) Re-set channel width with iw dev (assumes interface wlan0) ──────────
+  # ── 1) Re-set channel width with iw dev (assumes interface wlan0) ──────────
   channel=$(iw dev wlan0 info 2>/dev/null | awk '/channel/ {print $2}' | head -n1)
   if [ -n "$channel" ]; then
     if [ "$bandwidth" -eq 40 ]; then
@@ -140,7 +196,7 @@ EOF
     echo "Warning: could not determine current channel via 'iw dev'"
   fi
 
-  # ── 3) Send set_radio to wfb_tx_cmd (port 8000) ────────────────────────────
+  # ── 2) Send set_radio to wfb_tx_cmd (port 8000) ────────────────────────────
   wfb_tx_cmd 8000 set_radio \
       -B "$bandwidth" \
       -G "$gi_full" \
@@ -150,11 +206,15 @@ EOF
   wfb_tx_cmd 8000 set_fec -k 8 -n 12
   echo "Radio configured via wfb_tx_cmd."
 
-  # ── 4) Update gi,mcs in /etc/wfb.yaml ───────────────────────────────────────
-  yaml-cli -i "$WFB_CFG" -s .broadcast.mcs_index "$mcs" >/dev/null \
-    && echo "Updated wfb.yaml mcs_index → $mcs"
-  yaml-cli -i "$WFB_CFG" -s .wireless.gi "$gi_full" >/dev/null \
-    && echo "Updated wfb.yaml guard interval → $gi_full"
+  # ── 3) Persist width, FEC, mcs and gi in /etc/wfb.yaml (one write) ─────────
+  yaml_batch "$WFB_CFG" >/dev/null <<EOF \
+    && echo "Updated wfb.yaml width → $bandwidth MHz, fec → 8/12, mcs_index → $mcs, guard interval → $gi_full"
+set .wireless.width $bandwidth
+set .broadcast.fec_k 8
+set .broadcast.fec_n 12
+set .broadcast.mcs_index $mcs
+set .wireless.gi $gi_full
+EOF
 }
 
 ###############################################################################
@@ -168,11 +228,20 @@ set_preset() {
   [ -z "$exists" ] && { echo "Preset '$preset' not found for $adapter"; exit 1; }
 
   # Extract fields
-  vb=$(preset_val "$adapter" "$preset" video_bitrate)
-  lm=$(preset_val "$adapter" "$preset" link_mode)
-  fk=$(preset_val "$adapter" "$preset" fec_k)
-  fn=$(preset_val "$adapter" "$preset" fec_n)
-  ml=$(preset_val "$adapter" "$preset" mlink)
+  P=".profiles.$adapter.presets.$preset"
+  PRESET_KV=$(yaml_batch "$ADAPTER_CFG" <<EOF
+get $P.video_bitrate
+get $P.link_mode
+get $P.fec_k
+get $P.fec_n
+get $P.mlink
+EOF
+)
+  vb=$(kv "$PRESET_KV" "$P.video_bitrate")
+  lm=$(kv "$PRESET_KV" "$P.link_mode")
+  fk=$(kv "$PRESET_KV" "$P.fec_k")
+  fn=$(kv "$PRESET_KV" "$P.fec_n")
+  ml=$(kv "$PRESET_KV" "$P.mlink")
  
   echo "Applying preset '$preset'  (link_mode=$lm  bitrate=$vb kbps  FEC=$fk/$fn  mlink=$ml)"
 
@@ -180,9 +249,11 @@ set_preset() {
   "$0" --set "$lm" || { echo "Failed to set link mode"; exit 1; }
 
   # 2) Update FEC and mlink in wfb.yaml
-  yaml-cli -i "$WFB_CFG" -s .broadcast.fec_k "$fk"  >/dev/null
-  yaml-cli -i "$WFB_CFG" -s .broadcast.fec_n "$fn"  >/dev/null
-  yaml-cli -i "$WFB_CFG" -s .wireless.mlink  "$ml"  >/dev/null
+  yaml_batch "$WFB_CFG" >/dev/null <<EOF
+set .broadcast.fec_k $fk
+set .broadcast.fec_n $fn
+set .wireless.mlink $ml
+EOF
   echo "Updated FEC (k=$fk n=$fn) and mlink=$ml"
 
   # 3) Tell video encoder to change bitrate
@@ -214,14 +285,17 @@ get_auto() {
   #Assume a 50% FEC ratio overhead when selecting a auto mode.
   fec_n=12
   fec_k=8
-  width=$(yaml_num "$WFB_CFG" ".wireless.width");  [ -z "$width" ] && width=20
+  WFB_KV=$(printf 'get .wireless.width\nget .wireless.wlan_adapter\n' | yaml_batch "$WFB_CFG")
+  width=$(kv_num "$WFB_KV" ".wireless.width");  [ -z "$width" ] && width=20
   group=$(bw_group "$width")
-  adapter=$(yaml_str "$WFB_CFG" ".wireless.wlan_adapter")
+  adapter=$(kv "$WFB_KV" ".wireless.wlan_adapter")
+  keys=$(yaml_list "$ADAPTER_CFG" ".profiles.$adapter.link_modes.$group")
+  MODES_KV=$(mode_table $keys)
 
   required=$(printf "scale=4; %s * %s / %s / 1024\n" "$need_kbps" "$fec_n" "$fec_k" | bc -l)
   dbg "need_kbps=$need_kbps  FEC=$fec_k/$fec_n  width=$width($group)  required=$required Mbps"
 
-  for key in $(yaml_list "$ADAPTER_CFG" ".profiles.$adapter.link_modes.$group"); do
+  for key in $keys; do
     rate=$(net30 "$key"); raw=$(raw_rate "$key")
     dbg "  key=$key  raw=$raw  net30=$rate"
     if printf "%s >= %s\n" "$rate" "$required" | bc -l | grep -q 1; then
@@ -233,11 +307,17 @@ get_auto() {
 }
 
 ###############################################################################
+# link-modes (src/link-modes-cli.c) answers list/info/get-auto from one
+# parse of the YAML files; the shell versions below are the fallback.
+LINK_MODES=$(command -v link-modes 2>/dev/null)
+
 case "$1" in
-  --list-modes)   list_modes ;;
+  --list-modes)   [ -n "$LINK_MODES" ] && exec "$LINK_MODES" list; list_modes ;;
   --list-presets) list_presets ;;
-  --info)         info_adapter ;;
-  --get-auto)     shift; get_auto "$@" ;;
+  --info)         [ -n "$LINK_MODES" ] && exec "$LINK_MODES" info; info_adapter ;;
+  --get-auto)     shift
+                  [ -n "$LINK_MODES" ] && [ "$2" != "--verbose" ] && exec "$LINK_MODES" get-auto "$1"
+                  get_auto "$@" ;;
   --set)          set_mode "$@" ;;
   --set-preset)   set_preset "$@" ;;
   --verbose)      VERBOSE=1; shift; "$0" "$@" ;;